@@ -0,0 +1,79 @@
+// Benchmark.cpp
+// Synthetic benchmark scene, see Benchmark.h
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <glm/gtx/transform.hpp>
+
+#include "Benchmark.h"
+
+namespace
+{
+    // Unit box tapered towards the top, 4 vertices per face for flat normals and uvs.
+    // Faces run counter-clockwise seen from outside, so the normals point out.
+    void makeBox(const glm::vec3& size, float taper, std::vector<float>& vertices, std::vector<GLuint>& indices)
+    {
+        static const int faces[6][4] = {
+            { 0, 2, 3, 1 }, { 5, 7, 6, 4 },     // -z, +z
+            { 4, 6, 2, 0 }, { 1, 3, 7, 5 },     // -x, +x
+            { 4, 0, 1, 5 }, { 2, 6, 7, 3 }      // -y, +y
+        };
+        static const float uvs[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+        glm::vec3 corners[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            bool top = (i & 2) != 0;
+            float scale = top ? taper : 1.0f;
+            corners[i] = glm::vec3((i & 1 ? 0.5f : -0.5f) * size.x * scale,
+                                   (top ? 0.5f : -0.5f) * size.y,
+                                   (i & 4 ? 0.5f : -0.5f) * size.z * scale);
+        }
+
+        vertices.clear();
+        indices.clear();
+        for (int f = 0; f < 6; ++f)
+        {
+            const glm::vec3& a = corners[faces[f][0]];
+            const glm::vec3& b = corners[faces[f][1]];
+            const glm::vec3& c = corners[faces[f][2]];
+            glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+
+            GLuint first = (GLuint)(vertices.size() / 8);
+            for (int v = 0; v < 4; ++v)
+            {
+                const glm::vec3& p = corners[faces[f][v]];
+                float vertex[8] = { p.x, p.y, p.z, normal.x, normal.y, normal.z, uvs[v][0], uvs[v][1] };
+                vertices.insert(vertices.end(), vertex, vertex + 8);
+            }
+            GLuint quad[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+
+void UAddBenchmarkMeshes(StaticGeometryPool& pool, int meshCount, int layerCount)
+{
+    const PoolVertexLayout layout = { 8, 0, 3, 6 };
+    const float spacing = 0.6f;
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> extent(0.1f, 0.4f);
+    std::uniform_real_distribution<float> taper(0.3f, 1.0f);
+
+    // Square grid on the floor plane, starting behind the planet
+    int side = (int)std::ceil(std::sqrt((float)meshCount));
+    std::vector<float> vertices;
+    std::vector<GLuint> indices;
+    for (int i = 0; i < meshCount; ++i)
+    {
+        makeBox(glm::vec3(extent(random), extent(random) * 2.0f, extent(random)), taper(random), vertices, indices);
+        int mesh = pool.AddMesh(vertices.data(), vertices.size() / 8, layout, indices.data(), indices.size());
+
+        glm::vec3 position((i % side - side * 0.5f) * spacing, -0.5f, -6.0f - (i / side) * spacing);
+        pool.AddDraw(mesh, glm::translate(position), layerCount > 0 ? i % layerCount : -1);
+    }
+}
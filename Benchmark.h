@@ -0,0 +1,13 @@
+// Benchmark.h
+// Synthetic scene content for measuring submission cost
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "StaticGeometry.h"
+
+// Adds meshCount distinct boxes (different proportions and tapers) laid out on a
+// grid beyond the room, each drawn once with one of layerCount texture layers
+void UAddBenchmarkMeshes(StaticGeometryPool& pool, int meshCount, int layerCount);
+
+#endif
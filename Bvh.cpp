@@ -0,0 +1,353 @@
+// Bvh.cpp
+// Bounding volume hierarchy, see Bvh.h
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>         // cout, cerr
+#include <limits>
+
+#include "Bvh.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Cost of visiting a node relative to testing one object
+    const float TRAVERSAL_COST = 1.0f;
+
+    double secondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    glm::vec3 centroid(const Aabb& box)
+    {
+        return (box.min + box.max) * 0.5f;
+    }
+
+    bool sameBox(const Aabb& a, const Aabb& b)
+    {
+        return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+               a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+    }
+
+    // Distance where the ray enters the box, or a negative value when it
+    // misses it or enters beyond limit. inverse is 1 / direction per axis.
+    float rayEntry(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverse, float limit)
+    {
+        float enter = 0.0f, leave = limit;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float slabEnter = (box.min[axis] - origin[axis]) * inverse[axis];
+            float slabLeave = (box.max[axis] - origin[axis]) * inverse[axis];
+            if (slabEnter > slabLeave)
+                swap(slabEnter, slabLeave);
+            // NaN from 0 * infinity (origin on a slab with a parallel ray) keeps the current limits
+            enter = slabEnter > enter ? slabEnter : enter;
+            leave = slabLeave < leave ? slabLeave : leave;
+            if (enter > leave)
+                return -1.0f;
+        }
+        return enter;
+    }
+}
+
+
+void Bvh::Clear()
+{
+    nodes.clear();
+    objects.clear();
+    boxes.clear();
+    leafOf.clear();
+    buildCost = 0.0f;
+}
+
+
+Aabb Bvh::RangeBox(int first, int count) const
+{
+    Aabb box = boxes[objects[first]];
+    for (int i = first + 1; i < first + count; ++i)
+        box = UMergeBoxes(box, boxes[objects[i]]);
+    return box;
+}
+
+
+void Bvh::Build(const vector<Aabb>& objectBoxes)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Clear();
+    if (objectBoxes.empty())
+        return;
+
+    boxes = objectBoxes;
+    int objectCount = (int)boxes.size();
+    objects.resize(objectCount);
+    leafOf.resize(objectCount);
+    vector<glm::vec3> centroids(objectCount);
+    for (int i = 0; i < objectCount; ++i)
+    {
+        objects[i] = i;
+        centroids[i] = centroid(boxes[i]);
+    }
+
+    nodes.reserve(2 * objectCount);
+    nodes.push_back(Node{ RangeBox(0, objectCount), 0, objectCount, -1, -1 });
+
+    // Nodes waiting to be split; children are always stored after their parent
+    vector<int> pending(1, 0);
+    while (!pending.empty())
+    {
+        int index = pending.back();
+        pending.pop_back();
+        int first = nodes[index].first;
+        int count = nodes[index].count;
+
+        // Bin the centroids along the axis where they spread the most
+        glm::vec3 low = centroids[objects[first]], high = low;
+        for (int i = first + 1; i < first + count; ++i)
+        {
+            low = glm::min(low, centroids[objects[i]]);
+            high = glm::max(high, centroids[objects[i]]);
+        }
+        glm::vec3 spread = high - low;
+        int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+
+        int split = first + count / 2;  // when every centroid is the same, halve the run
+        if (spread[axis] > 0.0f)
+        {
+            Aabb binBoxes[BVH_SAH_BINS];
+            int binCounts[BVH_SAH_BINS] = {};
+            float binScale = BVH_SAH_BINS / spread[axis];
+            auto binOf = [&](int object)
+            {
+                return min(BVH_SAH_BINS - 1, int((centroids[object][axis] - low[axis]) * binScale));
+            };
+            for (int i = first; i < first + count; ++i)
+            {
+                int bin = binOf(objects[i]);
+                binBoxes[bin] = binCounts[bin] ? UMergeBoxes(binBoxes[bin], boxes[objects[i]]) : boxes[objects[i]];
+                ++binCounts[bin];
+            }
+
+            // Cost of splitting after each bin, from a sweep each way
+            float rightCosts[BVH_SAH_BINS] = {};
+            Aabb rightBox;
+            int rightCount = 0;
+            for (int bin = BVH_SAH_BINS - 1; bin > 0; --bin)
+            {
+                if (binCounts[bin])
+                {
+                    rightBox = rightCount ? UMergeBoxes(rightBox, binBoxes[bin]) : binBoxes[bin];
+                    rightCount += binCounts[bin];
+                }
+                rightCosts[bin - 1] = rightCount ? UBoxHalfArea(rightBox) * rightCount : 0.0f;
+            }
+            int bestBin = -1;
+            float bestCost = numeric_limits<float>::max();
+            Aabb leftBox;
+            int leftCount = 0;
+            for (int bin = 0; bin < BVH_SAH_BINS - 1; ++bin)
+            {
+                if (binCounts[bin])
+                {
+                    leftBox = leftCount ? UMergeBoxes(leftBox, binBoxes[bin]) : binBoxes[bin];
+                    leftCount += binCounts[bin];
+                }
+                if (leftCount == 0 || leftCount == count)
+                    continue;
+                float cost = UBoxHalfArea(leftBox) * leftCount + rightCosts[bin];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestBin = bin;
+                }
+            }
+
+            // Small runs stay leaves unless splitting is cheaper than testing each object
+            float nodeArea = UBoxHalfArea(nodes[index].box);
+            float splitCost = TRAVERSAL_COST + (nodeArea > 0.0f ? bestCost / nodeArea : 0.0f);
+            if (count <= BVH_MAX_LEAF_OBJECTS && (bestBin < 0 || splitCost >= count))
+                continue;
+            if (bestBin >= 0)
+                split = int(partition(objects.begin() + first, objects.begin() + first + count,
+                                      [&](int object) { return binOf(object) <= bestBin; }) - objects.begin());
+        }
+        else if (count <= BVH_MAX_LEAF_OBJECTS)
+            continue;
+
+        int left = (int)nodes.size();
+        nodes[index].left = left;
+        nodes.push_back(Node{ RangeBox(first, split - first), first, split - first, -1, index });
+        nodes.push_back(Node{ RangeBox(split, first + count - split), split, first + count - split, -1, index });
+        pending.push_back(left);
+        pending.push_back(left + 1);
+    }
+
+    for (int n = 0; n < (int)nodes.size(); ++n)
+        if (nodes[n].left < 0)
+            for (int i = nodes[n].first; i < nodes[n].first + nodes[n].count; ++i)
+                leafOf[objects[i]] = n;
+
+    buildCost = RefitCost();
+    buildSeconds = secondsSince(start);
+}
+
+
+void Bvh::Move(int object, const Aabb& box)
+{
+    if (object < 0 || object >= (int)boxes.size())
+        return;
+    boxes[object] = box;
+    ++moves;
+
+    int node = leafOf[object];
+    Aabb refit = RangeBox(nodes[node].first, nodes[node].count);
+    while (node >= 0 && !sameBox(refit, nodes[node].box))
+    {
+        nodes[node].box = refit;
+        node = nodes[node].parent;
+        if (node >= 0)
+            refit = UMergeBoxes(nodes[nodes[node].left].box, nodes[nodes[node].left + 1].box);
+    }
+}
+
+
+size_t Bvh::Cull(const Frustum& frustum, vector<unsigned char>& visible)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    visible.assign(boxes.size(), 0);
+    if (nodes.empty())
+        return 0;
+
+    size_t inside = 0;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        ++nodesVisited;
+
+        FrustumOverlap overlap = UBoxInFrustum(frustum, node.box);
+        if (overlap == FRUSTUM_OUTSIDE)
+            continue;
+        if (overlap == FRUSTUM_INSIDE)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+                visible[objects[i]] = 1;
+            inside += node.count;
+        }
+        else if (node.left >= 0)
+        {
+            stack.push_back(node.left);
+            stack.push_back(node.left + 1);
+        }
+        else
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                if (UBoxInFrustum(frustum, boxes[objects[i]]) == FRUSTUM_OUTSIDE)
+                    continue;
+                visible[objects[i]] = 1;
+                ++inside;
+            }
+        }
+    }
+
+    ++culls;
+    cullSeconds += secondsSince(start);
+    return inside;
+}
+
+
+int Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance,
+                 const function<bool(int object, float& distance)>& hit) const
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    ++raycasts;
+    int nearest = -1;
+    float best = maxDistance;
+    glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+    // Nodes the ray enters, with where it enters them
+    struct Pending
+    {
+        int node;
+        float entry;
+    };
+    vector<Pending> pending;
+    float rootEntry = nodes.empty() ? -1.0f : rayEntry(nodes[0].box, origin, inverse, best);
+    if (rootEntry >= 0.0f)
+        pending.push_back(Pending{ 0, rootEntry });
+    while (!pending.empty())
+    {
+        Pending top = pending.back();
+        pending.pop_back();
+        // A closer hit was found since the node was queued
+        if (top.entry > best)
+            continue;
+        const Node& node = nodes[top.node];
+
+        if (node.left >= 0)
+        {
+            // The nearer child goes on top, its hits shorten the search of the other
+            Pending children[2] = { { node.left, rayEntry(nodes[node.left].box, origin, inverse, best) },
+                                    { node.left + 1, rayEntry(nodes[node.left + 1].box, origin, inverse, best) } };
+            if (children[0].entry >= 0.0f && children[1].entry >= 0.0f && children[0].entry < children[1].entry)
+                swap(children[0], children[1]);
+            for (const Pending& child : children)
+                if (child.entry >= 0.0f)
+                    pending.push_back(child);
+            continue;
+        }
+
+        for (int i = node.first; i < node.first + node.count; ++i)
+        {
+            int object = objects[i];
+            float entry = rayEntry(boxes[object], origin, inverse, best);
+            if (entry < 0.0f)
+                continue;
+            if (hit && !hit(object, entry))
+                continue;
+            if (entry <= best)
+            {
+                best = entry;
+                nearest = object;
+            }
+        }
+    }
+
+    distance = best;
+    raycastSeconds += secondsSince(start);
+    return nearest;
+}
+
+
+float Bvh::RefitCost() const
+{
+    if (nodes.empty())
+        return 0.0f;
+
+    // Expected cost of a query relative to the root's area
+    float rootArea = UBoxHalfArea(nodes[0].box);
+    float cost = 0.0f;
+    for (const Node& node : nodes)
+    {
+        float area = UBoxHalfArea(node.box);
+        cost += area * (node.left >= 0 ? TRAVERSAL_COST : float(node.count));
+    }
+    return rootArea > 0.0f ? cost / rootArea : cost;
+}
+
+
+void Bvh::PrintStats() const
+{
+    cout << "INFO: BVH: " << boxes.size() << " objects in " << nodes.size() << " nodes, built in "
+         << buildSeconds * 1000.0 << " ms, cost " << buildCost << " built, " << RefitCost() << " now ("
+         << moves << " moves)" << endl;
+    if (culls)
+        cout << "INFO:   " << culls << " culls, " << cullSeconds * 1000.0 / culls << " ms and "
+             << nodesVisited / culls << " nodes per cull" << endl;
+    if (raycasts)
+        cout << "INFO:   " << raycasts << " picks, " << raycastSeconds * 1000.0 / raycasts << " ms per pick" << endl;
+}
@@ -0,0 +1,86 @@
+// Bvh.h
+// Bounding volume hierarchy over scene objects, for frustum culling and ray
+// picking. The tree is built top down, each split chosen with the surface
+// area heuristic over binned object centroids. Objects that move refit
+// their leaf and the nodes above it instead of rebuilding; the tree stays
+// correct but loosens, so callers rebuild once RefitCost() has grown well
+// past the cost right after Build.
+//
+// Every subtree's objects are one run of the object list, so a subtree
+// entirely inside the frustum is taken without visiting its nodes.
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Culling.h"
+
+// Objects a leaf may hold before it has to split
+const int BVH_MAX_LEAF_OBJECTS = 4;
+// Centroid bins each split considers
+const int BVH_SAH_BINS = 16;
+
+class Bvh
+{
+public:
+    Bvh() {}
+
+    // Objects are numbered by their place in boxes
+    void Build(const std::vector<Aabb>& boxes);
+    void Clear();
+
+    // Gives an object a new box and refits the nodes above it, stopping
+    // where a node's box no longer changes
+    void Move(int object, const Aabb& box);
+
+    // visible[object] becomes 1 when the object's box reaches into the
+    // frustum, else 0. Returns how many do.
+    size_t Cull(const Frustum& frustum, std::vector<unsigned char>& visible);
+
+    // Nearest object whose box the ray (direction normalized) meets within
+    // maxDistance, or -1. hit, when given, is asked about each object the
+    // ray reaches in its box: it returns false for a miss, or true with
+    // distance refined to the object's own surface.
+    int Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance,
+                const std::function<bool(int object, float& distance)>& hit = nullptr) const;
+
+    size_t ObjectCount() const { return boxes.size(); }
+    // Surface area heuristic cost of the tree as it is now
+    float RefitCost() const;
+    void PrintStats() const;
+
+private:
+    struct Node
+    {
+        Aabb box;
+        int first;          // the subtree's objects in objects[first, first + count)
+        int count;
+        int left;           // children at left and left + 1, -1 for a leaf
+        int parent;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> objects;   // object numbers, grouped by subtree
+    std::vector<Aabb> boxes;
+    std::vector<int> leafOf;    // leaf node of each object
+    std::vector<int> stack;     // traversal scratch
+
+    Aabb RangeBox(int first, int count) const;
+
+    // stats
+    float buildCost = 0.0f;
+    double buildSeconds = 0.0;
+    unsigned long long culls = 0;
+    unsigned long long nodesVisited = 0;
+    double cullSeconds = 0.0;
+    unsigned long long moves = 0;
+    mutable unsigned long long raycasts = 0;
+    mutable double raycastSeconds = 0.0;
+};
+
+#endif
@@ -0,0 +1,41 @@
+// CameraBuffer.cpp
+// Shared camera uniform block, see CameraBuffer.h
+
+#include "CameraBuffer.h"
+
+static_assert(sizeof(CameraBlock) == 3 * 64 + 16, "CameraBlock must match the std140 layout of the Camera block");
+
+
+bool CameraBuffer::Create()
+{
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // The binding never changes, programs declare it with layout(binding = 0)
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, buffer);
+    return buffer != 0;
+}
+
+
+void CameraBuffer::Destroy()
+{
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+
+void CameraBuffer::Update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float time)
+{
+    data.view = view;
+    data.projection = projection;
+    data.viewProjection = projection * view;
+    data.cameraPosition = cameraPosition;
+    data.time = time;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
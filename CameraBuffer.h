@@ -0,0 +1,50 @@
+// CameraBuffer.h
+// Per-frame camera data shared by every shader program through one std140
+// uniform block at a fixed binding point. GLSL side:
+//
+//   layout(std140, binding = 0) uniform Camera
+//   {
+//       mat4 view;
+//       mat4 projection;
+//       mat4 viewProjection;
+//       vec3 cameraPosition;
+//       float time;
+//   };
+
+#ifndef CAMERA_BUFFER_H
+#define CAMERA_BUFFER_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <glm/glm.hpp>
+
+// Uniform buffer binding point of the Camera block
+const GLuint CAMERA_BLOCK_BINDING = 0;
+
+// Mirrors the std140 layout of the Camera block
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+    float time;                 // packs into the vec3's last 4 bytes
+};
+
+class CameraBuffer
+{
+public:
+    bool Create();
+    void Destroy();
+
+    // Uploads this frame's camera data, once per frame before drawing
+    void Update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition, float time);
+
+    const CameraBlock& Data() const { return data; }
+
+private:
+    GLuint buffer = 0;
+    CameraBlock data;
+};
+
+#endif
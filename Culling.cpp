@@ -0,0 +1,285 @@
+// Culling.cpp
+// Bounding volumes and frustum tests, see Culling.h
+
+#include <algorithm>
+#include <cmath>            // sqrt
+#include <iostream>         // cout, cerr
+
+// The build targets the baseline instruction set. The 8-wide sphere test is
+// compiled for AVX on its own and only runs when the CPU reports AVX.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define CULLING_USE_AVX
+#define CULLING_AVX_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CULLING_USE_AVX
+#define CULLING_AVX_TARGET __attribute__((target("avx")))
+#endif
+
+#include "Culling.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Radius of the padding spheres, no distance is ever above its negation
+    const float PAD_RADIUS = -1e30f;
+
+    glm::vec4 normalizePlane(const glm::vec4& plane)
+    {
+        float length = glm::length(glm::vec3(plane));
+        return length > 0.0f ? plane * (1.0f / length) : plane;
+    }
+
+#ifdef CULLING_USE_AVX
+    // AVX needs the instructions and an OS that saves the 256 bit registers
+    bool cpuHasAvx()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        return avx && osSavesYmm;
+#else
+        return __builtin_cpu_supports("avx") != 0;
+#endif
+    }
+
+    bool useAvx()
+    {
+        static const bool supported = cpuHasAvx();
+        return supported;
+    }
+
+    // 8 spheres per iteration: a lane stays set while its sphere is on the
+    // inner side of every plane. count is a multiple of CULL_BATCH.
+    CULLING_AVX_TARGET void cullSpheresAvx(const Frustum& frustum, const float* x, const float* y, const float* z,
+                                           const float* radius, size_t count, unsigned char* visible)
+    {
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+            planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+            planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+            planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+        }
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (size_t i = 0; i < count; i += CULL_BATCH)
+        {
+            __m256 cx = _mm256_loadu_ps(x + i);
+            __m256 cy = _mm256_loadu_ps(y + i);
+            __m256 cz = _mm256_loadu_ps(z + i);
+            __m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(radius + i));
+            __m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)),
+                                                _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+                in = _mm256_and_ps(in, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+            int mask = _mm256_movemask_ps(in);
+            for (size_t lane = 0; lane < CULL_BATCH; ++lane)
+                visible[i + lane] = (unsigned char)((mask >> lane) & 1);
+        }
+    }
+#endif
+}
+
+
+Bounds UComputeBounds(const float* vertices, size_t vertexCount, size_t stride)
+{
+    Bounds bounds;
+    if (vertexCount == 0)
+        return bounds;
+
+    bounds.min = bounds.max = glm::vec3(vertices[0], vertices[1], vertices[2]);
+    for (size_t v = 1; v < vertexCount; ++v)
+    {
+        const float* p = vertices + v * stride;
+        bounds.min = glm::min(bounds.min, glm::vec3(p[0], p[1], p[2]));
+        bounds.max = glm::max(bounds.max, glm::vec3(p[0], p[1], p[2]));
+    }
+
+    // Sphere around the box's center, a little larger than the tightest but found in one pass
+    bounds.center = (bounds.min + bounds.max) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const float* p = vertices + v * stride;
+        glm::vec3 offset = glm::vec3(p[0], p[1], p[2]) - bounds.center;
+        radiusSquared = max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.radius = sqrt(radiusSquared);
+    return bounds;
+}
+
+
+void UTransformSphere(const Bounds& bounds, const glm::mat4& model, glm::vec3& center, float& radius)
+{
+    float scale = max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+    radius = bounds.radius * scale;
+}
+
+
+Aabb UTransformBox(const Bounds& bounds, const glm::mat4& model)
+{
+    // The box's half extents along each world axis, summed over the model's columns
+    glm::vec3 center = glm::vec3(model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+    glm::vec3 worldExtent = glm::abs(glm::vec3(model[0])) * extent.x +
+                            glm::abs(glm::vec3(model[1])) * extent.y +
+                            glm::abs(glm::vec3(model[2])) * extent.z;
+    Aabb box;
+    box.min = center - worldExtent;
+    box.max = center + worldExtent;
+    return box;
+}
+
+
+Aabb UMergeBoxes(const Aabb& a, const Aabb& b)
+{
+    Aabb box;
+    box.min = glm::min(a.min, b.min);
+    box.max = glm::max(a.max, b.max);
+    return box;
+}
+
+
+float UBoxHalfArea(const Aabb& box)
+{
+    glm::vec3 size = box.max - box.min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+
+Frustum UExtractFrustum(const glm::mat4& viewProjection)
+{
+    // Rows of the matrix; a clip space point is inside when -w <= x, y, z <= w
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r)
+        rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    Frustum frustum;
+    frustum.planes[0] = normalizePlane(rows[3] + rows[0]);
+    frustum.planes[1] = normalizePlane(rows[3] - rows[0]);
+    frustum.planes[2] = normalizePlane(rows[3] + rows[1]);
+    frustum.planes[3] = normalizePlane(rows[3] - rows[1]);
+    frustum.planes[4] = normalizePlane(rows[3] + rows[2]);
+    frustum.planes[5] = normalizePlane(rows[3] - rows[2]);
+    return frustum;
+}
+
+
+bool USphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+    for (const glm::vec4& plane : frustum.planes)
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    return true;
+}
+
+
+FrustumOverlap UBoxInFrustum(const Frustum& frustum, const Aabb& box)
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    FrustumOverlap overlap = FRUSTUM_INSIDE;
+    for (const glm::vec4& plane : frustum.planes)
+    {
+        // Distance of the center, and how far the box reaches along the plane normal
+        float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+        float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+        if (distance < -reach)
+            return FRUSTUM_OUTSIDE;
+        if (distance < reach)
+            overlap = FRUSTUM_INTERSECTS;
+    }
+    return overlap;
+}
+
+
+size_t SphereSet::Add(const glm::vec3& center, float sphereRadius)
+{
+    // Grow a whole batch at a time, filled with padding
+    if (count == x.size())
+    {
+        size_t padded = x.size() + CULL_BATCH;
+        x.resize(padded, 0.0f);
+        y.resize(padded, 0.0f);
+        z.resize(padded, 0.0f);
+        radius.resize(padded, PAD_RADIUS);
+    }
+    Set(count, center, sphereRadius);
+    return count++;
+}
+
+
+void SphereSet::Set(size_t index, const glm::vec3& center, float sphereRadius)
+{
+    x[index] = center.x;
+    y[index] = center.y;
+    z[index] = center.z;
+    radius[index] = sphereRadius;
+}
+
+
+void SphereSet::Clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    count = 0;
+}
+
+
+size_t SphereSet::Cull(const Frustum& frustum, vector<unsigned char>& visible)
+{
+    visible.resize(x.size());
+    size_t inside = 0;
+
+    bool vectorized = false;
+#ifdef CULLING_USE_AVX
+    vectorized = useAvx();
+    if (vectorized)
+        cullSpheresAvx(frustum, x.data(), y.data(), z.data(), radius.data(), x.size(), visible.data());
+#endif
+    if (!vectorized)
+    {
+        for (size_t i = 0; i < x.size(); ++i)
+            visible[i] = USphereInFrustum(frustum, glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+    }
+
+    visible.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        inside += visible[i];
+
+    ++culls;
+    tested += count;
+    culled += count - inside;
+    lastVisible = inside;
+    return inside;
+}
+
+
+void SphereSet::PrintStats(const char* name) const
+{
+    cout << "INFO: Frustum culling (" << name << "): " << count << " objects, ";
+    if (culls)
+    {
+        cout << lastVisible << " drawn last frame, " << 100.0 * culled / tested << "% culled over " << culls << " frames";
+#ifdef CULLING_USE_AVX
+        if (useAvx())
+            cout << " (AVX)";
+#endif
+        cout << endl;
+    }
+    else
+        cout << "never culled" << endl;
+}
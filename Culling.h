@@ -0,0 +1,94 @@
+// Culling.h
+// Bounding volumes and view frustum tests. Meshes get an axis aligned box
+// and a bounding sphere when they are created; each frame the spheres of
+// every draw, moved to world space, are tested against the six planes of
+// the camera's frustum and draws entirely outside are skipped.
+//
+// Spheres are tested in batches of CULL_BATCH from separate x, y, z and
+// radius arrays, 8 per iteration with AVX when the CPU has it.
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Spheres per SIMD iteration, sphere arrays are padded to a multiple of it
+const size_t CULL_BATCH = 8;
+
+// Box and sphere around a mesh, in mesh units
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    glm::vec3 center = glm::vec3(0.0f);    // of the box
+    float radius = 0.0f;                    // around center
+};
+
+// Bounds of vertexCount vertices, stride floats apart with the position first
+Bounds UComputeBounds(const float* vertices, size_t vertexCount, size_t stride);
+// World space sphere of bounds drawn at model; the radius grows with the largest axis scale
+void UTransformSphere(const Bounds& bounds, const glm::mat4& model, glm::vec3& center, float& radius);
+
+// Axis aligned box, for the BVH
+struct Aabb
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+};
+
+// World space box around bounds drawn at model
+Aabb UTransformBox(const Bounds& bounds, const glm::mat4& model);
+Aabb UMergeBoxes(const Aabb& a, const Aabb& b);
+// Half the surface area, the surface area heuristic only compares ratios
+float UBoxHalfArea(const Aabb& box);
+
+// Planes facing inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+    glm::vec4 planes[6];    // left, right, bottom, top, near, far
+};
+
+// Planes of the clip volume of projection * view, in world space
+Frustum UExtractFrustum(const glm::mat4& viewProjection);
+bool USphereInFrustum(const Frustum& frustum, const glm::vec3& center, float radius);
+
+enum FrustumOverlap
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE      // entirely inside, so is everything the box holds
+};
+FrustumOverlap UBoxInFrustum(const Frustum& frustum, const Aabb& box);
+
+// Spheres stored by component for batch tests, with counts of what culling removed
+class SphereSet
+{
+public:
+    SphereSet() {}
+
+    size_t Add(const glm::vec3& center, float radius);
+    void Set(size_t index, const glm::vec3& center, float radius);
+    void Clear();
+    size_t Size() const { return count; }
+
+    // visible[i] becomes 1 when sphere i reaches into the frustum, else 0.
+    // Returns how many do.
+    size_t Cull(const Frustum& frustum, std::vector<unsigned char>& visible);
+
+    void PrintStats(const char* name) const;
+
+private:
+    std::vector<float> x, y, z, radius;     // padded with spheres outside every frustum
+    size_t count = 0;
+
+    // stats over every Cull
+    unsigned long long culls = 0;
+    unsigned long long tested = 0;
+    unsigned long long culled = 0;
+    size_t lastVisible = 0;
+};
+
+#endif
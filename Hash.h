@@ -0,0 +1,29 @@
+// Hash.h
+// 64 bit FNV-1a hashing for cache keys
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <string>
+
+const unsigned long long HASH_SEED = 14695981039346656037ULL;
+
+// Hashes size bytes starting at data, chaining from a previous hash if given
+inline unsigned long long UHashBytes(const void* data, size_t size, unsigned long long hash = HASH_SEED)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline unsigned long long UHashString(const std::string& text, unsigned long long hash = HASH_SEED)
+{
+    return UHashBytes(text.data(), text.size(), hash);
+}
+
+#endif
@@ -0,0 +1,148 @@
+// MappedFile.cpp
+// Memory mapped file reader, see MappedFile.h
+
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+using namespace std; // Standard namespace
+
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+    return Map(filename) || Read(filename);
+}
+
+
+#ifdef _WIN32
+
+bool MappedFile::Map(const char* filename)
+{
+    // Decoders walk the file front to back once
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const unsigned char*>(view);
+    size = size_t(fileSize.QuadPart);
+    mapped = true;
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+    if (mapped)
+    {
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = nullptr;
+    }
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+#else
+
+bool MappedFile::Map(const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+    // Decoders walk the file front to back once
+    madvise(view, size_t(info.st_size), MADV_SEQUENTIAL);
+
+    fileDescriptor = fd;
+    data = static_cast<const unsigned char*>(view);
+    size = size_t(info.st_size);
+    mapped = true;
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+    if (mapped)
+    {
+        munmap(const_cast<unsigned char*>(data), size);
+        close(fileDescriptor);
+        fileDescriptor = -1;
+    }
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+#endif
+
+
+bool MappedFile::Read(const char* filename)
+{
+    ifstream in(filename, ios::binary);
+    if (!in)
+        return false;
+
+    buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
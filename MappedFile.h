@@ -0,0 +1,47 @@
+// MappedFile.h
+// Read only view of a whole file. The file is memory mapped where possible,
+// so decoders read straight from the page cache; files that cannot be
+// mapped (empty files, pipes, some network shares) are read into memory.
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <vector>
+
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps filename, falling back to reading it. Returns false if the file cannot be read.
+    bool Open(const char* filename);
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+    // True when Data() points into a mapping rather than a copy
+    bool IsMapped() const { return mapped; }
+
+private:
+    bool Map(const char* filename);
+    bool Read(const char* filename);
+
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<unsigned char> buffer;      // fallback copy
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fileDescriptor = -1;
+#endif
+};
+
+#endif
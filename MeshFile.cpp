@@ -0,0 +1,139 @@
+// MeshFile.cpp
+// Binary mesh files, see MeshFile.h
+
+#include <fstream>
+#include <iostream>         // cout, cerr
+#include <vector>
+
+#include "MeshFile.h"
+#include "MeshWeld.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const uint32_t MESH_FILE_MAGIC = 0x4853454D;   // "MESH"
+    const uint32_t MESH_FILE_VERSION = 1;
+
+    static_assert(sizeof(MeshFileHeader) == 48, "MeshFileHeader is written as is and must not change size");
+
+    uint64_t alignUp(uint64_t offset)
+    {
+        return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+    }
+
+    void pad(ofstream& out, uint64_t from, uint64_t to)
+    {
+        static const char zeros[MESH_FILE_ALIGNMENT] = {};
+        out.write(zeros, streamsize(to - from));
+    }
+
+    int32_t byteOffset(int floats)
+    {
+        return floats >= 0 ? int32_t(floats * sizeof(float)) : -1;
+    }
+
+    int floatOffset(int32_t bytes)
+    {
+        return bytes >= 0 ? int(bytes / sizeof(float)) : -1;
+    }
+
+    // Attribute fits in the vertex and is float aligned
+    bool validAttribute(int32_t offset, uint32_t floats, uint32_t stride)
+    {
+        return offset < 0 || (offset % sizeof(float) == 0 && offset + floats * sizeof(float) <= stride);
+    }
+}
+
+
+bool USaveMeshFile(const char* filename, const float* vertices, size_t vertexCount, const PoolVertexLayout& layout,
+                   const GLuint* indices, size_t indexCount)
+{
+    vector<float> welded;
+    vector<GLuint> weldedIndices;
+    if (!indices)
+    {
+        vertexCount = UWeldVertices(vertices, vertexCount, layout.stride, welded, weldedIndices);
+        vertices = welded.data();
+        indices = weldedIndices.data();
+        indexCount = weldedIndices.size();
+    }
+
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexCount = (uint32_t)vertexCount;
+    header.indexCount = (uint32_t)indexCount;
+    header.vertexStride = uint32_t(layout.stride * sizeof(float));
+    header.positionOffset = byteOffset(layout.position);
+    header.normalOffset = byteOffset(layout.normal);
+    header.uvOffset = byteOffset(layout.uv);
+    header.vertexOffset = alignUp(sizeof(header));
+    uint64_t vertexBytes = uint64_t(vertexCount) * header.vertexStride;
+    header.indexOffset = alignUp(header.vertexOffset + vertexBytes);
+
+    ofstream out(filename, ios::binary);
+    if (!out)
+    {
+        cout << "Could not write mesh file " << filename << endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(out, sizeof(header), header.vertexOffset);
+    out.write(reinterpret_cast<const char*>(vertices), streamsize(vertexBytes));
+    pad(out, header.vertexOffset + vertexBytes, header.indexOffset);
+    out.write(reinterpret_cast<const char*>(indices), streamsize(indexCount * sizeof(GLuint)));
+    return bool(out);
+}
+
+
+bool MeshFile::Open(const char* filename)
+{
+    Close();
+    if (!file.Open(filename))
+        return false;
+
+    // Mappings are page aligned and the fallback copy is heap aligned, so the header can be read in place
+    const MeshFileHeader* candidate = reinterpret_cast<const MeshFileHeader*>(file.Data());
+    bool valid = file.Size() >= sizeof(MeshFileHeader) &&
+                 candidate->magic == MESH_FILE_MAGIC && candidate->version == MESH_FILE_VERSION &&
+                 candidate->vertexStride > 0 && candidate->vertexStride % sizeof(float) == 0 &&
+                 candidate->positionOffset >= 0 &&
+                 validAttribute(candidate->positionOffset, 3, candidate->vertexStride) &&
+                 validAttribute(candidate->normalOffset, 3, candidate->vertexStride) &&
+                 validAttribute(candidate->uvOffset, 2, candidate->vertexStride) &&
+                 candidate->vertexOffset % MESH_FILE_ALIGNMENT == 0 && candidate->indexOffset % MESH_FILE_ALIGNMENT == 0 &&
+                 candidate->vertexOffset + uint64_t(candidate->vertexCount) * candidate->vertexStride <= file.Size() &&
+                 candidate->indexOffset + uint64_t(candidate->indexCount) * sizeof(GLuint) <= file.Size();
+    if (!valid)
+    {
+        cout << "Mesh file " << filename << " is not a valid mesh" << endl;
+        file.Close();
+        return false;
+    }
+
+    // An index past the vertices would read outside the buffer on the GPU
+    header = candidate;
+    const GLuint* indices = Indices();
+    for (uint32_t i = 0; i < header->indexCount; ++i)
+    {
+        if (indices[i] >= header->vertexCount)
+        {
+            cout << "Mesh file " << filename << " has out of range indices" << endl;
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+PoolVertexLayout MeshFile::Layout() const
+{
+    PoolVertexLayout layout;
+    layout.stride = int(header->vertexStride / sizeof(float));
+    layout.position = floatOffset(header->positionOffset);
+    layout.normal = floatOffset(header->normalOffset);
+    layout.uv = floatOffset(header->uvOffset);
+    return layout;
+}
@@ -0,0 +1,61 @@
+// MeshFile.h
+// Compact binary mesh file: a fixed header describing the vertex layout,
+// then the vertex blob and the index blob, each starting on a
+// MESH_FILE_ALIGNMENT boundary. The blobs are stored exactly as they are
+// uploaded, so a loaded file is used straight from its memory mapping.
+//
+//   MeshFileHeader | pad | vertices (vertexCount * vertexStride bytes) | pad | indices (indexCount uint32)
+
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstddef>
+#include <cstdint>
+
+#include "MappedFile.h"
+#include "StaticGeometry.h"
+
+// Blob alignment within the file, enough for any vertex attribute format
+const size_t MESH_FILE_ALIGNMENT = 16;
+
+struct MeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t vertexStride;          // bytes
+    // Byte offsets of the float attributes within a vertex, -1 when absent
+    int32_t positionOffset;         // 3 floats
+    int32_t normalOffset;           // 3 floats
+    int32_t uvOffset;               // 2 floats
+    uint64_t vertexOffset;          // from the start of the file
+    uint64_t indexOffset;
+};
+
+// Writes a mesh. Vertices without indices are welded first.
+bool USaveMeshFile(const char* filename, const float* vertices, size_t vertexCount, const PoolVertexLayout& layout,
+                   const GLuint* indices = nullptr, size_t indexCount = 0);
+
+// Read only view of a mapped mesh file
+class MeshFile
+{
+public:
+    // Maps and validates filename, false if it is missing or malformed
+    bool Open(const char* filename);
+    void Close() { file.Close(); header = nullptr; }
+
+    const MeshFileHeader& Header() const { return *header; }
+    const float* Vertices() const { return reinterpret_cast<const float*>(file.Data() + header->vertexOffset); }
+    const GLuint* Indices() const { return reinterpret_cast<const GLuint*>(file.Data() + header->indexOffset); }
+    // The vertex layout in floats, as StaticGeometryPool takes it
+    PoolVertexLayout Layout() const;
+
+private:
+    MappedFile file;
+    const MeshFileHeader* header = nullptr;
+};
+
+#endif
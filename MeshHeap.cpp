@@ -0,0 +1,293 @@
+// MeshHeap.cpp
+// Suballocated mesh buffers, see MeshHeap.h
+
+#include <algorithm>
+#include <iostream>         // cout, cerr
+
+#include "MeshHeap.h"
+#include "RenderState.h"
+#include "VertexLayout.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const size_t VERTEX_SIZE = MeshVertexLayout::stride;
+
+    size_t alignUp(size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // Immutable storage the CPU updates with glBufferSubData
+    GLuint createBuffer(size_t size)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    void upload(GLuint buffer, size_t offset, size_t size, const void* data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+
+void RangeAllocator::Reset(size_t newCapacity)
+{
+    byOffset.clear();
+    bySize.clear();
+    capacity = newCapacity;
+    used = 0;
+    if (capacity)
+        Insert(0, capacity);
+}
+
+
+void RangeAllocator::Grow(size_t newCapacity)
+{
+    if (newCapacity <= capacity)
+        return;
+    size_t oldCapacity = capacity;
+    capacity = newCapacity;
+    Release(oldCapacity, newCapacity - oldCapacity);
+}
+
+
+size_t RangeAllocator::Allocate(size_t size, size_t alignment)
+{
+    if (size == 0)
+        return INVALID;
+    alignment = max<size_t>(alignment, 1);
+
+    // Best fit: the smallest range that holds size after aligning its start
+    for (auto candidate = bySize.lower_bound(size); candidate != bySize.end(); ++candidate)
+    {
+        size_t rangeOffset = candidate->second;
+        size_t rangeSize = candidate->first;
+        size_t offset = alignUp(rangeOffset, alignment);
+        if (offset - rangeOffset + size > rangeSize)
+            continue;
+
+        // The alignment gap and the tail stay free
+        Erase(byOffset.find(rangeOffset));
+        if (offset > rangeOffset)
+            Insert(rangeOffset, offset - rangeOffset);
+        if (offset + size < rangeOffset + rangeSize)
+            Insert(offset + size, rangeOffset + rangeSize - offset - size);
+        used += size;
+        return offset;
+    }
+    return INVALID;
+}
+
+
+void RangeAllocator::Free(size_t offset, size_t size)
+{
+    if (size == 0)
+        return;
+    used -= size;
+    Release(offset, size);
+}
+
+
+void RangeAllocator::Release(size_t offset, size_t size)
+{
+    auto next = byOffset.lower_bound(offset);
+    if (next != byOffset.end() && next->first == offset + size)
+    {
+        size += next->second;
+        auto merged = next++;
+        Erase(merged);
+    }
+    if (next != byOffset.begin())
+    {
+        auto previous = prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            Erase(previous);
+        }
+    }
+    Insert(offset, size);
+}
+
+
+void RangeAllocator::Insert(size_t offset, size_t size)
+{
+    byOffset[offset] = size;
+    bySize.insert(make_pair(size, offset));
+}
+
+
+void RangeAllocator::Erase(map<size_t, size_t>::iterator range)
+{
+    auto sized = bySize.equal_range(range->second);
+    for (auto it = sized.first; it != sized.second; ++it)
+    {
+        if (it->second == range->first)
+        {
+            bySize.erase(it);
+            break;
+        }
+    }
+    byOffset.erase(range);
+}
+
+
+double RangeAllocator::Fragmentation() const
+{
+    size_t free = capacity - used;
+    return free ? 1.0 - double(LargestFreeRange()) / double(free) : 0.0;
+}
+
+
+bool MeshHeap::Create(size_t vertexBytes, size_t indexBytes)
+{
+    Destroy();
+
+    vertexBytes = alignUp(vertexBytes, VERTEX_SIZE);
+    vertexBuffer = createBuffer(vertexBytes);
+    indexBuffer = createBuffer(indexBytes);
+    vertexRanges.Reset(vertexBytes);
+    indexRanges.Reset(indexBytes);
+
+    glGenVertexArrays(1, &vertexArray);
+    URenderState().BindVertexArray(vertexArray);
+    MeshVertexLayout::Apply(VERTEX_BUFFER_BINDING);
+    Attach();
+    return true;
+}
+
+
+void MeshHeap::Destroy()
+{
+    if (vertexArray)
+    {
+        URenderState().ForgetVertexArray(vertexArray);
+        glDeleteVertexArrays(1, &vertexArray);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+    vertexArray = vertexBuffer = indexBuffer = 0;
+    vertexRanges.Reset(0);
+    indexRanges.Reset(0);
+    meshes = 0;
+}
+
+
+void MeshHeap::Attach()
+{
+    URenderState().BindVertexArray(vertexArray);
+    MeshVertexLayout::Bind(VERTEX_BUFFER_BINDING, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    URenderState().BindVertexArray(0);
+}
+
+
+bool MeshHeap::Reserve(RangeAllocator& ranges, GLuint& buffer, size_t size, size_t alignment, size_t& offset)
+{
+    offset = ranges.Allocate(size, alignment);
+    if (offset != RangeAllocator::INVALID)
+        return true;
+
+    // Double until the request fits at the end, then copy on the GPU
+    size_t oldCapacity = ranges.Capacity();
+    size_t newCapacity = max<size_t>(oldCapacity, 1);
+    while (newCapacity < oldCapacity + size + alignment)
+        newCapacity *= 2;
+    newCapacity = alignUp(newCapacity, alignment);
+
+    GLuint grown = createBuffer(newCapacity);
+    if (!grown)
+        return false;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCapacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    buffer = grown;
+    ++grows;
+
+    ranges.Grow(newCapacity);
+    offset = ranges.Allocate(size, alignment);
+    return offset != RangeAllocator::INVALID;
+}
+
+
+bool MeshHeap::Allocate(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                        MeshAllocation& allocation)
+{
+    allocation = MeshAllocation();
+    if (!vertexArray || vertexCount == 0)
+        return false;
+
+    // Vertex ranges start on a whole vertex, so the offset is a baseVertex
+    unsigned growsBefore = grows;
+    size_t vertexOffset, indexOffset = 0;
+    bool reserved = Reserve(vertexRanges, vertexBuffer, vertexCount * VERTEX_SIZE, VERTEX_SIZE, vertexOffset);
+    if (reserved && indexCount && !Reserve(indexRanges, indexBuffer, indexCount * sizeof(GLuint), sizeof(GLuint), indexOffset))
+    {
+        vertexRanges.Free(vertexOffset, vertexCount * VERTEX_SIZE);
+        reserved = false;
+    }
+    // A grown buffer replaced one the vertex array points at
+    if (grows != growsBefore)
+        Attach();
+    if (!reserved)
+    {
+        cout << "Failed to allocate " << vertexCount << " vertices in the mesh heap" << endl;
+        return false;
+    }
+
+    upload(vertexBuffer, vertexOffset, vertexCount * VERTEX_SIZE, vertices);
+    if (indexCount)
+        upload(indexBuffer, indexOffset, indexCount * sizeof(GLuint), indices);
+
+    allocation.baseVertex = GLint(vertexOffset / VERTEX_SIZE);
+    allocation.firstIndex = GLuint(indexOffset / sizeof(GLuint));
+    allocation.vertexCount = GLsizei(vertexCount);
+    allocation.indexCount = GLsizei(indexCount);
+    ++meshes;
+    ++allocations;
+    return true;
+}
+
+
+void MeshHeap::Free(MeshAllocation& allocation)
+{
+    if (!allocation.IsValid())
+        return;
+
+    vertexRanges.Free(allocation.baseVertex * VERTEX_SIZE, allocation.vertexCount * VERTEX_SIZE);
+    indexRanges.Free(allocation.firstIndex * sizeof(GLuint), allocation.indexCount * sizeof(GLuint));
+    allocation = MeshAllocation();
+    --meshes;
+    ++frees;
+}
+
+
+void MeshHeap::PrintStats() const
+{
+    const RangeAllocator* heaps[] = { &vertexRanges, &indexRanges };
+    const char* names[] = { "vertices", "indices" };
+
+    cout << "INFO: Mesh heap: " << meshes << " meshes (" << allocations << " allocated, " << frees << " freed), "
+         << grows << " grows" << endl;
+    for (int i = 0; i < 2; ++i)
+    {
+        const RangeAllocator& ranges = *heaps[i];
+        double utilization = ranges.Capacity() ? 100.0 * ranges.Used() / ranges.Capacity() : 0.0;
+        cout << "INFO:   " << names[i] << ": " << ranges.Used() / 1024 << " of " << ranges.Capacity() / 1024 << " KB used ("
+             << utilization << "%), " << ranges.FreeRangeCount() << " free ranges, largest "
+             << ranges.LargestFreeRange() / 1024 << " KB, fragmentation " << 100.0 * ranges.Fragmentation() << "%" << endl;
+    }
+}
@@ -0,0 +1,112 @@
+// MeshHeap.h
+// Meshes that come and go at run time, suballocated out of one vertex
+// buffer and one index buffer. Every mesh in the heap shares a single
+// vertex array; a mesh is just a vertex range (drawn with its baseVertex)
+// and an index range (its firstIndex), so consecutive heap draws need no
+// VAO or buffer changes. Freed ranges return to a free list that merges
+// neighbours, and a full heap grows by copying into larger buffers on the
+// GPU, which keeps every existing offset valid.
+
+#ifndef MESH_HEAP_H
+#define MESH_HEAP_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstddef>
+#include <map>
+
+// Initial sizes of the heap's buffers
+const size_t MESH_HEAP_VERTEX_BYTES = 16 * 1024 * 1024;
+const size_t MESH_HEAP_INDEX_BYTES = 8 * 1024 * 1024;
+
+// Offset allocator over [0, capacity). Free ranges are kept by offset, to
+// merge a freed range with its neighbours, and by size, for best fit.
+class RangeAllocator
+{
+public:
+    static const size_t INVALID = size_t(-1);
+
+    // Starts over with everything free
+    void Reset(size_t capacity);
+    // Extends the range to newCapacity, the new space is free
+    void Grow(size_t newCapacity);
+
+    // Returns an offset that is a multiple of alignment (any value, not only
+    // powers of two), or INVALID when no free range fits
+    size_t Allocate(size_t size, size_t alignment);
+    // Returns a range given out by Allocate
+    void Free(size_t offset, size_t size);
+
+    size_t Capacity() const { return capacity; }
+    size_t Used() const { return used; }
+    size_t FreeRangeCount() const { return byOffset.size(); }
+    size_t LargestFreeRange() const { return bySize.empty() ? 0 : bySize.rbegin()->first; }
+    // 0 when the free space is one range, towards 1 as it splits into small ones
+    double Fragmentation() const;
+
+private:
+    void Insert(size_t offset, size_t size);
+    void Erase(std::map<size_t, size_t>::iterator range);
+    // Inserts a free range, merged with the free ranges it touches
+    void Release(size_t offset, size_t size);
+
+    size_t capacity = 0;
+    size_t used = 0;
+    std::map<size_t, size_t> byOffset;      // offset -> size
+    std::multimap<size_t, size_t> bySize;   // size -> offset
+};
+
+// A mesh's place in the heap
+struct MeshAllocation
+{
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;
+
+    bool IsValid() const { return vertexCount > 0; }
+};
+
+class MeshHeap
+{
+public:
+    MeshHeap() {}
+    ~MeshHeap() { Destroy(); }
+
+    MeshHeap(const MeshHeap&) = delete;
+    MeshHeap& operator=(const MeshHeap&) = delete;
+
+    bool Create(size_t vertexBytes = MESH_HEAP_VERTEX_BYTES, size_t indexBytes = MESH_HEAP_INDEX_BYTES);
+    void Destroy();
+
+    // Uploads a mesh in MeshVertexLayout (8 floats per vertex) with its
+    // indices, growing the heap if needed. False if the buffers cannot grow.
+    bool Allocate(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                  MeshAllocation& allocation);
+    // Releases the mesh's ranges; draws already issued still read the old contents
+    void Free(MeshAllocation& allocation);
+
+    // Shared by every mesh in the heap
+    GLuint VertexArray() const { return vertexArray; }
+    void PrintStats() const;
+
+private:
+    // Allocates from ranges, growing buffer (and replacing its id) when full
+    bool Reserve(RangeAllocator& ranges, GLuint& buffer, size_t size, size_t alignment, size_t& offset);
+    // Points the vertex array at the current buffers
+    void Attach();
+
+    GLuint vertexArray = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+
+    // stats
+    size_t meshes = 0;
+    unsigned long long allocations = 0;
+    unsigned long long frees = 0;
+    unsigned grows = 0;
+};
+
+#endif
@@ -0,0 +1,1145 @@
+// MeshImport.cpp
+// OBJ and glTF importers, see MeshImport.h
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>         // cout, cerr
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "MeshImport.h"
+#include "Parallel.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Chunks per worker, so a chunk full of comments does not idle a thread
+    const size_t OBJ_CHUNKS_PER_WORKER = 4;
+    // Smaller files are parsed as one chunk
+    const size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+    // Vertices converted per glTF slice and thread
+    const size_t GLTF_MIN_VERTICES_PER_THREAD = 16 * 1024;
+
+    bool hasExtension(const string& filename, const char* extension)
+    {
+        size_t length = strlen(extension);
+        if (filename.size() < length)
+            return false;
+        for (size_t i = 0; i < length; ++i)
+            if (tolower((unsigned char)filename[filename.size() - length + i]) != extension[i])
+                return false;
+        return true;
+    }
+
+    string directoryOf(const string& filename)
+    {
+        size_t slash = filename.find_last_of("/\\");
+        return slash == string::npos ? string() : filename.substr(0, slash + 1);
+    }
+
+    void reportImport(const char* filename, const ImportedMesh& mesh, chrono::steady_clock::time_point start)
+    {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "INFO: Imported " << filename << ": " << mesh.VertexCount() << " vertices, " << mesh.indices.size() / 3
+             << " triangles in " << ms << " ms (" << UWorkerCount() << " threads)" << endl;
+    }
+
+    // Smooth normals for the vertices with derive[v] set: the area weighted
+    // sum of the normals of the triangles around each. Vertices hold 8
+    // floats, indices minus baseVertex address them.
+    void deriveNormals(float* vertices, const vector<bool>& derive, const GLuint* indices, size_t indexCount, GLuint baseVertex)
+    {
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+        {
+            float* a = vertices + size_t(indices[i] - baseVertex) * 8;
+            float* b = vertices + size_t(indices[i + 1] - baseVertex) * 8;
+            float* c = vertices + size_t(indices[i + 2] - baseVertex) * 8;
+            float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+            for (int k = 0; k < 3; ++k)
+            {
+                if (derive[indices[i + k] - baseVertex])
+                {
+                    float* corner = vertices + size_t(indices[i + k] - baseVertex) * 8;
+                    for (int j = 0; j < 3; ++j)
+                        corner[3 + j] += normal[j];
+                }
+            }
+        }
+        for (size_t v = 0; v < derive.size(); ++v)
+        {
+            if (!derive[v])
+                continue;
+            float* normal = vertices + v * 8 + 3;
+            float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (length > 0.0f)
+                for (int k = 0; k < 3; ++k)
+                    normal[k] /= length;
+        }
+    }
+
+    // --- OBJ ---------------------------------------------------------------
+
+    bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p < end && isBlank(*p))
+            ++p;
+        return p;
+    }
+
+    // strtof without the locale and without a terminating zero, which the
+    // mapping does not have
+    const char* parseFloat(const char* p, const char* end, float& value)
+    {
+        p = skipBlanks(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        double mantissa = 0.0;
+        int exponent = 0;
+        bool digits = false;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            mantissa = mantissa * 10.0 + (*p++ - '0');
+            digits = true;
+        }
+        if (p < end && *p == '.')
+        {
+            ++p;
+            while (p < end && *p >= '0' && *p <= '9')
+            {
+                mantissa = mantissa * 10.0 + (*p++ - '0');
+                --exponent;
+                digits = true;
+            }
+        }
+        if (!digits)
+            return nullptr;
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char* e = p + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+'))
+                negativeExponent = *e++ == '-';
+            if (e < end && *e >= '0' && *e <= '9')
+            {
+                int power = 0;
+                while (e < end && *e >= '0' && *e <= '9')
+                    power = min(power * 10 + (*e++ - '0'), 1000);
+                exponent += negativeExponent ? -power : power;
+                p = e;
+            }
+        }
+
+        double scale = 1.0, base = 10.0;
+        for (int power = abs(exponent); power; power >>= 1, base *= base)
+            if (power & 1)
+                scale *= base;
+        mantissa = exponent < 0 ? mantissa / scale : mantissa * scale;
+        value = float(negative ? -mantissa : mantissa);
+        return p;
+    }
+
+    const char* parseInt(const char* p, const char* end, long long& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+        if (p >= end || *p < '0' || *p > '9')
+            return nullptr;
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value * 10 + (*p++ - '0');
+        if (negative)
+            value = -value;
+        return p;
+    }
+
+    enum ObjRecord { OBJ_OTHER, OBJ_POSITION, OBJ_UV, OBJ_NORMAL, OBJ_FACE };
+
+    // Record type of the line at p, rest points past the keyword
+    ObjRecord objRecord(const char* p, const char* end, const char*& rest)
+    {
+        p = skipBlanks(p, end);
+        rest = p;
+        if (p + 1 >= end || (!isBlank(p[1]) && p[1] != 't' && p[1] != 'n'))
+            return OBJ_OTHER;
+        if (p[0] == 'f' && isBlank(p[1]))
+        {
+            rest = p + 2;
+            return OBJ_FACE;
+        }
+        if (p[0] != 'v')
+            return OBJ_OTHER;
+        if (isBlank(p[1]))
+        {
+            rest = p + 2;
+            return OBJ_POSITION;
+        }
+        if (p + 2 < end && isBlank(p[2]))
+        {
+            rest = p + 3;
+            return p[1] == 't' ? OBJ_UV : OBJ_NORMAL;
+        }
+        return OBJ_OTHER;
+    }
+
+    // One face corner, 0-based attribute indices, -1 when absent
+    struct ObjCorner
+    {
+        int position, uv, normal;
+
+        bool operator==(const ObjCorner& other) const
+        {
+            return position == other.position && uv == other.uv && normal == other.normal;
+        }
+    };
+
+    // Line aligned slice of the file and what was parsed from it
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+
+        // counted in the first pass, turned into the global index of the
+        // chunk's first record before the second
+        size_t positions = 0, uvs = 0, normals = 0;
+
+        vector<ObjCorner> corners;      // fan triangulated faces
+        vector<float> vertices;         // unique corners of the chunk, 8 floats each
+        vector<GLuint> indices;         // into vertices
+        size_t firstVertex = 0;         // in the merged mesh
+        size_t firstIndex = 0;
+
+        const char* error = nullptr;
+        size_t errorLine = 0;           // within the chunk
+    };
+
+    // Splits the text into about count pieces that end after a newline
+    vector<ObjChunk> splitLines(const char* data, size_t size, size_t count)
+    {
+        vector<ObjChunk> chunks;
+        const char* end = data + size;
+        const char* begin = data;
+        size_t target = max<size_t>(size / max<size_t>(count, 1), 1);
+        while (begin < end)
+        {
+            const char* split = begin + min<size_t>(target, end - begin);
+            split = static_cast<const char*>(memchr(split, '\n', end - split));
+            split = split ? split + 1 : end;
+
+            ObjChunk chunk;
+            chunk.begin = begin;
+            chunk.end = split;
+            chunks.push_back(std::move(chunk));
+            begin = split;
+        }
+        return chunks;
+    }
+
+    template <typename Func>
+    void forEachLine(const char* begin, const char* end, Func func)
+    {
+        while (begin < end)
+        {
+            const char* newline = static_cast<const char*>(memchr(begin, '\n', end - begin));
+            const char* lineEnd = newline ? newline : end;
+            if (!func(begin, lineEnd))
+                return;
+            begin = lineEnd + 1;
+        }
+    }
+
+    void countObjRecords(ObjChunk& chunk)
+    {
+        forEachLine(chunk.begin, chunk.end, [&chunk](const char* line, const char* end)
+        {
+            const char* rest;
+            switch (objRecord(line, end, rest))
+            {
+            case OBJ_POSITION: ++chunk.positions; break;
+            case OBJ_UV: ++chunk.uvs; break;
+            case OBJ_NORMAL: ++chunk.normals; break;
+            default: break;
+            }
+            return true;
+        });
+    }
+
+    // OBJ indices are 1-based, negative ones count back from the last record so far
+    bool resolveIndex(long long index, size_t countSoFar, size_t total, int& resolved)
+    {
+        long long absolute = index > 0 ? index - 1 : (long long)countSoFar + index;
+        if (index == 0 || absolute < 0 || absolute >= (long long)total)
+            return false;
+        resolved = int(absolute);
+        return true;
+    }
+
+    // Parses the chunk's records, writing attributes into the shared arrays
+    // at the chunk's global offsets (counted before, so no two chunks touch
+    // the same range) and collecting the triangulated face corners
+    void parseObjChunk(ObjChunk& chunk, vector<float>& positions, vector<float>& uvs, vector<float>& normals)
+    {
+        size_t position = chunk.positions, uv = chunk.uvs, normal = chunk.normals;
+        size_t positionCount = positions.size() / 3, uvCount = uvs.size() / 2, normalCount = normals.size() / 3;
+        vector<ObjCorner> polygon;
+        size_t lineNumber = 0;
+
+        forEachLine(chunk.begin, chunk.end, [&](const char* line, const char* end)
+        {
+            ++lineNumber;
+            const char* p;
+            switch (objRecord(line, end, p))
+            {
+            case OBJ_POSITION:
+                for (int i = 0; i < 3 && p; ++i)
+                    p = parseFloat(p, end, positions[position * 3 + i]);
+                ++position;
+                break;
+            case OBJ_UV:
+                p = parseFloat(p, end, uvs[uv * 2]);
+                // v is optional for 1D textures
+                if (p && !parseFloat(p, end, uvs[uv * 2 + 1]))
+                    uvs[uv * 2 + 1] = 0.0f;
+                ++uv;
+                break;
+            case OBJ_NORMAL:
+                for (int i = 0; i < 3 && p; ++i)
+                    p = parseFloat(p, end, normals[normal * 3 + i]);
+                ++normal;
+                break;
+            case OBJ_FACE:
+                polygon.clear();
+                for (p = skipBlanks(p, end); p && p < end; p = skipBlanks(p, end))
+                {
+                    ObjCorner corner = { -1, -1, -1 };
+                    long long index;
+                    // v, v/vt, v//vn or v/vt/vn
+                    p = parseInt(p, end, index);
+                    if (!p || !resolveIndex(index, position, positionCount, corner.position))
+                    {
+                        p = nullptr;
+                        break;
+                    }
+                    if (p < end && *p == '/')
+                    {
+                        ++p;
+                        if (p < end && *p != '/')
+                        {
+                            p = parseInt(p, end, index);
+                            if (!p || !resolveIndex(index, uv, uvCount, corner.uv))
+                            {
+                                p = nullptr;
+                                break;
+                            }
+                        }
+                        if (p < end && *p == '/')
+                        {
+                            p = parseInt(p + 1, end, index);
+                            if (!p || !resolveIndex(index, normal, normalCount, corner.normal))
+                            {
+                                p = nullptr;
+                                break;
+                            }
+                        }
+                    }
+                    polygon.push_back(corner);
+                }
+                if (!p || polygon.size() < 3)
+                {
+                    chunk.error = "bad face";
+                    break;
+                }
+                for (size_t i = 2; i < polygon.size(); ++i)
+                {
+                    chunk.corners.push_back(polygon[0]);
+                    chunk.corners.push_back(polygon[i - 1]);
+                    chunk.corners.push_back(polygon[i]);
+                }
+                return true;
+            default:
+                return true;
+            }
+            if (!p && !chunk.error)
+                chunk.error = "bad number";
+            if (chunk.error)
+                chunk.errorLine = lineNumber;
+            return chunk.error == nullptr;
+        });
+    }
+
+    // Turns the chunk's corners into unique vertices and indices. Corners
+    // are only shared within the chunk; a corner used on both sides of a
+    // chunk boundary becomes two vertices, which costs a few bytes and keeps
+    // the chunks independent.
+    void indexObjChunk(ObjChunk& chunk, const vector<float>& positions, const vector<float>& uvs, const vector<float>& normals)
+    {
+        size_t capacity = 16;
+        while (capacity < chunk.corners.size() * 2)
+            capacity *= 2;
+        vector<GLuint> slots(capacity, GLuint(-1));
+        vector<ObjCorner> unique;
+        unique.reserve(chunk.corners.size() / 4);
+        chunk.indices.reserve(chunk.corners.size());
+
+        for (const ObjCorner& corner : chunk.corners)
+        {
+            size_t slot = size_t(UHashBytes(&corner, sizeof(corner))) & (capacity - 1);
+            while (slots[slot] != GLuint(-1) && !(unique[slots[slot]] == corner))
+                slot = (slot + 1) & (capacity - 1);
+            if (slots[slot] == GLuint(-1))
+            {
+                slots[slot] = GLuint(unique.size());
+                unique.push_back(corner);
+            }
+            chunk.indices.push_back(slots[slot]);
+        }
+
+        chunk.vertices.assign(unique.size() * 8, 0.0f);
+        for (size_t i = 0; i < unique.size(); ++i)
+        {
+            float* vertex = &chunk.vertices[i * 8];
+            memcpy(vertex, &positions[unique[i].position * 3], 3 * sizeof(float));
+            if (unique[i].normal >= 0)
+                memcpy(vertex + 3, &normals[unique[i].normal * 3], 3 * sizeof(float));
+            if (unique[i].uv >= 0)
+                memcpy(vertex + 6, &uvs[unique[i].uv * 2], 2 * sizeof(float));
+        }
+
+        // A file with normals may still write faces as v or v/vt; their
+        // corners would keep zero normals in a mesh that reports having them
+        if (!normals.empty())
+        {
+            vector<bool> derive(unique.size());
+            bool missing = false;
+            for (size_t i = 0; i < unique.size(); ++i)
+                missing |= derive[i] = unique[i].normal < 0;
+            if (missing)
+                deriveNormals(chunk.vertices.data(), derive, chunk.indices.data(), chunk.indices.size(), 0);
+        }
+        vector<ObjCorner>().swap(chunk.corners);
+    }
+
+    // --- glTF --------------------------------------------------------------
+
+    // Just enough JSON for a glTF document
+    struct JsonValue
+    {
+        enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+        bool boolean = false;
+        double number = 0.0;
+        string text;
+        vector<JsonValue> items;
+        vector<pair<string, JsonValue>> members;
+
+        const JsonValue* Find(const char* key) const
+        {
+            for (const auto& member : members)
+                if (member.first == key)
+                    return &member.second;
+            return nullptr;
+        }
+
+        const JsonValue* At(size_t index) const
+        {
+            return type == ARRAY && index < items.size() ? &items[index] : nullptr;
+        }
+
+        double Number(const char* key, double fallback) const
+        {
+            const JsonValue* value = Find(key);
+            return value && value->type == NUMBER ? value->number : fallback;
+        }
+
+        const string& Text(const char* key) const
+        {
+            static const string empty;
+            const JsonValue* value = Find(key);
+            return value && value->type == STRING ? value->text : empty;
+        }
+    };
+
+    class JsonParser
+    {
+    public:
+        JsonParser(const char* text, size_t size) : p(text), end(text + size) {}
+
+        bool Parse(JsonValue& value)
+        {
+            return ParseValue(value, 0) && (SkipSpace(), p == end);
+        }
+
+    private:
+        static const int MAX_DEPTH = 64;
+
+        void SkipSpace()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                ++p;
+        }
+
+        bool Literal(const char* word)
+        {
+            size_t length = strlen(word);
+            if (size_t(end - p) < length || memcmp(p, word, length) != 0)
+                return false;
+            p += length;
+            return true;
+        }
+
+        bool ParseValue(JsonValue& value, int depth)
+        {
+            SkipSpace();
+            if (p >= end || depth > MAX_DEPTH)
+                return false;
+            switch (*p)
+            {
+            case '{': return ParseObject(value, depth);
+            case '[': return ParseArray(value, depth);
+            case '"': value.type = JsonValue::STRING; return ParseString(value.text);
+            case 't': value.type = JsonValue::BOOLEAN; value.boolean = true; return Literal("true");
+            case 'f': value.type = JsonValue::BOOLEAN; return Literal("false");
+            case 'n': return Literal("null");
+            default: return ParseNumber(value);
+            }
+        }
+
+        bool ParseNumber(JsonValue& value)
+        {
+            const char* start = p;
+            while (p < end && (strchr("+-.eE", *p) || (*p >= '0' && *p <= '9')))
+                ++p;
+            if (p == start)
+                return false;
+            // Copy so strtod stops at the token end; glTF numbers are short
+            string token(start, p);
+            char* stop;
+            value.type = JsonValue::NUMBER;
+            value.number = strtod(token.c_str(), &stop);
+            return *stop == '\0';
+        }
+
+        bool ParseString(string& text)
+        {
+            ++p;
+            while (p < end && *p != '"')
+            {
+                if (*p != '\\')
+                {
+                    text += *p++;
+                    continue;
+                }
+                if (++p >= end)
+                    return false;
+                char escape = *p++;
+                switch (escape)
+                {
+                case 'b': text += '\b'; break;
+                case 'f': text += '\f'; break;
+                case 'n': text += '\n'; break;
+                case 'r': text += '\r'; break;
+                case 't': text += '\t'; break;
+                case 'u':
+                {
+                    if (end - p < 4)
+                        return false;
+                    unsigned code = 0;
+                    for (const char* digit = p; digit < p + 4; ++digit)
+                    {
+                        if (!isxdigit((unsigned char)*digit))
+                            return false;
+                        code = code * 16 + (*digit <= '9' ? *digit - '0' : (tolower((unsigned char)*digit) - 'a' + 10));
+                    }
+                    p += 4;
+                    // UTF-8, surrogate pairs are not combined (glTF names and URIs are ASCII in practice)
+                    if (code < 0x80)
+                        text += char(code);
+                    else if (code < 0x800)
+                    {
+                        text += char(0xC0 | (code >> 6));
+                        text += char(0x80 | (code & 0x3F));
+                    }
+                    else
+                    {
+                        text += char(0xE0 | (code >> 12));
+                        text += char(0x80 | ((code >> 6) & 0x3F));
+                        text += char(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: text += escape; break;
+                }
+            }
+            if (p >= end)
+                return false;
+            ++p;
+            return true;
+        }
+
+        bool ParseArray(JsonValue& value, int depth)
+        {
+            value.type = JsonValue::ARRAY;
+            ++p;
+            SkipSpace();
+            if (p < end && *p == ']')
+                return ++p, true;
+            for (;;)
+            {
+                value.items.emplace_back();
+                if (!ParseValue(value.items.back(), depth + 1))
+                    return false;
+                SkipSpace();
+                if (p < end && *p == ',')
+                    ++p;
+                else if (p < end && *p == ']')
+                    return ++p, true;
+                else
+                    return false;
+            }
+        }
+
+        bool ParseObject(JsonValue& value, int depth)
+        {
+            value.type = JsonValue::OBJECT;
+            ++p;
+            SkipSpace();
+            if (p < end && *p == '}')
+                return ++p, true;
+            for (;;)
+            {
+                SkipSpace();
+                value.members.emplace_back();
+                if (p >= end || *p != '"' || !ParseString(value.members.back().first))
+                    return false;
+                SkipSpace();
+                if (p >= end || *p++ != ':')
+                    return false;
+                if (!ParseValue(value.members.back().second, depth + 1))
+                    return false;
+                SkipSpace();
+                if (p < end && *p == ',')
+                    ++p;
+                else if (p < end && *p == '}')
+                    return ++p, true;
+                else
+                    return false;
+            }
+        }
+
+        const char* p;
+        const char* end;
+    };
+
+    const uint32_t GLB_MAGIC = 0x46546C67;         // "glTF"
+    const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;    // "JSON"
+    const uint32_t GLB_CHUNK_BIN = 0x004E4942;     // "BIN\0"
+
+    const int GLTF_MODE_TRIANGLES = 4;
+
+    // Component types
+    const int GLTF_BYTE = 5120;
+    const int GLTF_UNSIGNED_BYTE = 5121;
+    const int GLTF_SHORT = 5122;
+    const int GLTF_UNSIGNED_SHORT = 5123;
+    const int GLTF_UNSIGNED_INT = 5125;
+    const int GLTF_FLOAT = 5126;
+
+    size_t componentSize(int componentType)
+    {
+        switch (componentType)
+        {
+        case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+        default: return 0;
+        }
+    }
+
+    int componentCount(const string& type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        return 0;
+    }
+
+    struct GltfBuffer
+    {
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+    };
+
+    // Resolved accessor: element i starts at data + i * stride
+    struct GltfAccessor
+    {
+        const unsigned char* data = nullptr;
+        size_t stride = 0;
+        size_t count = 0;
+        int componentType = 0;
+        int components = 0;
+        bool normalized = false;
+
+        float Component(size_t element, int component) const
+        {
+            const unsigned char* p = data + element * stride + component * componentSize(componentType);
+            switch (componentType)
+            {
+            case GLTF_FLOAT: { float v; memcpy(&v, p, 4); return v; }
+            case GLTF_UNSIGNED_BYTE: return normalized ? *p / 255.0f : float(*p);
+            case GLTF_BYTE: { float v = float(int8_t(*p)); return normalized ? max(v / 127.0f, -1.0f) : v; }
+            case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p, 2); return normalized ? v / 65535.0f : float(v); }
+            case GLTF_SHORT: { int16_t v; memcpy(&v, p, 2); return normalized ? max(v / 32767.0f, -1.0f) : float(v); }
+            case GLTF_UNSIGNED_INT: { uint32_t v; memcpy(&v, p, 4); return float(v); }
+            default: return 0.0f;
+            }
+        }
+
+        GLuint Index(size_t element) const
+        {
+            const unsigned char* p = data + element * stride;
+            switch (componentType)
+            {
+            case GLTF_UNSIGNED_BYTE: return *p;
+            case GLTF_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p, 2); return v; }
+            default: { uint32_t v; memcpy(&v, p, 4); return v; }
+            }
+        }
+    };
+
+    // Vertices and indices one primitive appended to the mesh
+    struct GltfRange
+    {
+        size_t firstVertex, endVertex;
+        size_t firstIndex, endIndex;
+    };
+
+    class GltfDocument
+    {
+    public:
+        bool Load(const char* filename);
+        bool Import(ImportedMesh& mesh) const;
+
+    private:
+        bool LoadBuffers(const string& directory);
+        bool Accessor(double index, GltfAccessor& accessor) const;
+        bool ImportPrimitive(const JsonValue& primitive, ImportedMesh& mesh, bool& hasNormals) const;
+
+        MappedFile file;
+        JsonValue root;
+        GltfBuffer binaryChunk;                         // .glb BIN chunk
+        vector<unique_ptr<MappedFile>> externalFiles;   // .bin files
+        vector<vector<unsigned char>> decoded;          // data: URIs
+        vector<GltfBuffer> buffers;
+    };
+
+    bool decodeBase64(const char* text, size_t length, vector<unsigned char>& bytes)
+    {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        unsigned bits = 0;
+        int count = 0;
+        bytes.reserve(length * 3 / 4);
+        for (size_t i = 0; i < length && text[i] != '='; ++i)
+        {
+            const char* digit = strchr(alphabet, text[i]);
+            if (!digit || !*digit)
+                return false;
+            bits = (bits << 6) | unsigned(digit - alphabet);
+            count += 6;
+            if (count >= 8)
+            {
+                count -= 8;
+                bytes.push_back((unsigned char)(bits >> count));
+            }
+        }
+        return true;
+    }
+
+    bool GltfDocument::Load(const char* filename)
+    {
+        if (!file.Open(filename))
+        {
+            cout << "Error: could not read " << filename << endl;
+            return false;
+        }
+
+        const char* json = reinterpret_cast<const char*>(file.Data());
+        size_t jsonSize = file.Size();
+        uint32_t magic = 0;
+        if (file.Size() >= 12)
+            memcpy(&magic, file.Data(), 4);
+        if (magic == GLB_MAGIC)
+        {
+            // 12 byte header, then a JSON chunk and an optional BIN chunk
+            size_t offset = 12;
+            jsonSize = 0;
+            while (offset + 8 <= file.Size())
+            {
+                uint32_t length, type;
+                memcpy(&length, file.Data() + offset, 4);
+                memcpy(&type, file.Data() + offset + 4, 4);
+                offset += 8;
+                if (length > file.Size() - offset)
+                    break;
+                if (type == GLB_CHUNK_JSON && !jsonSize)
+                {
+                    json = reinterpret_cast<const char*>(file.Data() + offset);
+                    jsonSize = length;
+                }
+                else if (type == GLB_CHUNK_BIN && !binaryChunk.data)
+                {
+                    binaryChunk.data = file.Data() + offset;
+                    binaryChunk.size = length;
+                }
+                offset += (length + 3) & ~size_t(3);
+            }
+            if (!jsonSize)
+            {
+                cout << "Error: " << filename << " has no JSON chunk" << endl;
+                return false;
+            }
+        }
+
+        if (!JsonParser(json, jsonSize).Parse(root) || root.type != JsonValue::OBJECT)
+        {
+            cout << "Error: " << filename << " is not valid glTF JSON" << endl;
+            return false;
+        }
+        return LoadBuffers(directoryOf(filename));
+    }
+
+    bool GltfDocument::LoadBuffers(const string& directory)
+    {
+        const JsonValue* list = root.Find("buffers");
+        size_t count = list && list->type == JsonValue::ARRAY ? list->items.size() : 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const JsonValue& buffer = list->items[i];
+            const string& uri = buffer.Text("uri");
+            GltfBuffer resolved;
+            if (uri.empty())
+                resolved = binaryChunk;
+            else if (uri.compare(0, 5, "data:") == 0)
+            {
+                size_t comma = uri.find(";base64,");
+                decoded.emplace_back();
+                if (comma == string::npos || !decodeBase64(uri.c_str() + comma + 8, uri.size() - comma - 8, decoded.back()))
+                {
+                    cout << "Error: glTF buffer " << i << " has an unsupported data URI" << endl;
+                    return false;
+                }
+                resolved.data = decoded.back().data();
+                resolved.size = decoded.back().size();
+            }
+            else
+            {
+                // Percent-encoded URIs are not decoded, exporters rarely write them
+                string path = directory + uri;
+                externalFiles.emplace_back(new MappedFile);
+                if (!externalFiles.back()->Open(path.c_str()))
+                {
+                    cout << "Error: could not read glTF buffer " << path << endl;
+                    return false;
+                }
+                resolved.data = externalFiles.back()->Data();
+                resolved.size = externalFiles.back()->Size();
+            }
+
+            double byteLength = buffer.Number("byteLength", 0.0);
+            if (!resolved.data || byteLength > resolved.size)
+            {
+                cout << "Error: glTF buffer " << i << " is missing or shorter than its byteLength" << endl;
+                return false;
+            }
+            buffers.push_back(resolved);
+        }
+        return true;
+    }
+
+    // index as read from the JSON, negative when the property was missing
+    bool GltfDocument::Accessor(double index, GltfAccessor& accessor) const
+    {
+        const JsonValue* accessors = root.Find("accessors");
+        const JsonValue* description = accessors && index >= 0 ? accessors->At(size_t(index)) : nullptr;
+        if (!description)
+            return false;
+
+        accessor.componentType = int(description->Number("componentType", 0));
+        accessor.components = componentCount(description->Text("type"));
+        accessor.count = size_t(description->Number("count", 0));
+        const JsonValue* normalized = description->Find("normalized");
+        accessor.normalized = normalized && normalized->boolean;
+        size_t elementSize = componentSize(accessor.componentType) * accessor.components;
+        if (!elementSize || description->Find("sparse"))
+            return false;
+
+        // Accessors without a view are all zeros, which no importer use needs
+        const JsonValue* views = root.Find("bufferViews");
+        double viewIndex = description->Number("bufferView", -1);
+        const JsonValue* view = views && viewIndex >= 0 ? views->At(size_t(viewIndex)) : nullptr;
+        if (!view)
+            return false;
+        double bufferIndex = view->Number("buffer", -1);
+        if (bufferIndex < 0 || bufferIndex >= buffers.size())
+            return false;
+
+        const GltfBuffer& buffer = buffers[size_t(bufferIndex)];
+        size_t viewOffset = size_t(view->Number("byteOffset", 0));
+        size_t viewLength = size_t(view->Number("byteLength", 0));
+        size_t offset = size_t(description->Number("byteOffset", 0));
+        accessor.stride = size_t(view->Number("byteStride", 0));
+        if (!accessor.stride)
+            accessor.stride = elementSize;
+
+        // The last element must end inside the view, and the view inside the buffer
+        if (viewOffset + viewLength > buffer.size || accessor.stride < elementSize ||
+            (accessor.count && offset + (accessor.count - 1) * accessor.stride + elementSize > viewLength))
+            return false;
+        accessor.data = buffer.data + viewOffset + offset;
+        return true;
+    }
+
+    bool GltfDocument::ImportPrimitive(const JsonValue& primitive, ImportedMesh& mesh, bool& hasNormals) const
+    {
+        if (primitive.Number("mode", GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES)
+            return true;    // points and lines have no surface to draw
+
+        const JsonValue* attributes = primitive.Find("attributes");
+        if (!attributes)
+            return false;
+        GltfAccessor positions, normals, uvs, indices;
+        if (!Accessor(attributes->Number("POSITION", -1), positions) || positions.components != 3)
+            return false;
+
+        hasNormals = attributes->Find("NORMAL") != nullptr;
+        bool hasUvs = attributes->Find("TEXCOORD_0") != nullptr;
+        if (hasNormals && (!Accessor(attributes->Number("NORMAL", -1), normals) || normals.components != 3 || normals.count != positions.count))
+            return false;
+        if (hasUvs && (!Accessor(attributes->Number("TEXCOORD_0", -1), uvs) || uvs.components != 2 || uvs.count != positions.count))
+            return false;
+        bool indexed = primitive.Find("indices") != nullptr;
+        if (indexed && (!Accessor(primitive.Number("indices", -1), indices) || indices.components != 1 || indices.componentType == GLTF_FLOAT))
+            return false;
+
+        size_t firstVertex = mesh.VertexCount();
+        size_t firstIndex = mesh.indices.size();
+        size_t indexCount = indexed ? indices.count : positions.count;
+        mesh.hasNormals |= hasNormals;
+        mesh.hasUvs |= hasUvs;
+        mesh.vertices.resize(mesh.vertices.size() + positions.count * 8, 0.0f);
+        mesh.indices.resize(firstIndex + indexCount / 3 * 3);
+
+        float* out = mesh.vertices.data() + firstVertex * 8;
+        UParallelFor(positions.count, GLTF_MIN_VERTICES_PER_THREAD, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                float* vertex = out + i * 8;
+                for (int c = 0; c < 3; ++c)
+                    vertex[c] = positions.Component(i, c);
+                if (hasNormals)
+                    for (int c = 0; c < 3; ++c)
+                        vertex[3 + c] = normals.Component(i, c);
+                if (hasUvs)
+                {
+                    // glTF puts the uv origin at the top left
+                    vertex[6] = uvs.Component(i, 0);
+                    vertex[7] = 1.0f - uvs.Component(i, 1);
+                }
+            }
+        });
+
+        atomic<bool> inRange{ true };
+        GLuint* outIndices = mesh.indices.data() + firstIndex;
+        size_t vertexCount = positions.count;
+        UParallelFor(mesh.indices.size() - firstIndex, GLTF_MIN_VERTICES_PER_THREAD, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                GLuint index = indexed ? indices.Index(i) : GLuint(i);
+                if (index >= vertexCount)
+                {
+                    inRange = false;
+                    return;
+                }
+                outIndices[i] = GLuint(firstVertex) + index;
+            }
+        });
+        return inRange;
+    }
+
+    bool GltfDocument::Import(ImportedMesh& mesh) const
+    {
+        // Primitives without normals, derived once another primitive brings its own
+        vector<GltfRange> withoutNormals;
+        const JsonValue* meshes = root.Find("meshes");
+        size_t count = meshes && meshes->type == JsonValue::ARRAY ? meshes->items.size() : 0;
+        for (size_t m = 0; m < count; ++m)
+        {
+            const JsonValue* primitives = meshes->items[m].Find("primitives");
+            size_t primitiveCount = primitives && primitives->type == JsonValue::ARRAY ? primitives->items.size() : 0;
+            for (size_t p = 0; p < primitiveCount; ++p)
+            {
+                GltfRange range = { mesh.VertexCount(), 0, mesh.indices.size(), 0 };
+                bool hasNormals = true;
+                if (!ImportPrimitive(primitives->items[p], mesh, hasNormals))
+                {
+                    cout << "Error: glTF mesh " << m << " primitive " << p << " has unsupported or invalid accessors" << endl;
+                    return false;
+                }
+                range.endVertex = mesh.VertexCount();
+                range.endIndex = mesh.indices.size();
+                if (!hasNormals)
+                    withoutNormals.push_back(range);
+            }
+        }
+        // The mesh is one vertex layout: either every primitive has normals or none does
+        if (mesh.hasNormals)
+            for (const GltfRange& range : withoutNormals)
+            {
+                vector<bool> derive(range.endVertex - range.firstVertex, true);
+                deriveNormals(mesh.vertices.data() + range.firstVertex * 8, derive, mesh.indices.data() + range.firstIndex,
+                              range.endIndex - range.firstIndex, GLuint(range.firstVertex));
+            }
+        return true;
+    }
+}
+
+
+bool UImportMesh(const char* filename, ImportedMesh& mesh)
+{
+    string name = filename;
+    if (hasExtension(name, ".obj"))
+        return UImportObj(filename, mesh);
+    if (hasExtension(name, ".gltf") || hasExtension(name, ".glb"))
+        return UImportGltf(filename, mesh);
+
+    cout << "Error: " << filename << " is not an .obj, .gltf or .glb file" << endl;
+    return false;
+}
+
+
+bool UImportObj(const char* filename, ImportedMesh& mesh)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mesh = ImportedMesh();
+
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        cout << "Error: could not read " << filename << endl;
+        return false;
+    }
+
+    const char* text = reinterpret_cast<const char*>(file.Data());
+    size_t chunkCount = min(UWorkerCount() * OBJ_CHUNKS_PER_WORKER, file.Size() / OBJ_MIN_CHUNK_SIZE + 1);
+    vector<ObjChunk> chunks = splitLines(text, file.Size(), chunkCount);
+
+    // Pass 1: count records per chunk, so every chunk knows where its
+    // attributes go and what a negative index refers to
+    UParallelFor(chunks.size(), 1, [&chunks](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            countObjRecords(chunks[i]);
+    });
+    size_t positionCount = 0, uvCount = 0, normalCount = 0;
+    for (ObjChunk& chunk : chunks)
+    {
+        swap(chunk.positions, positionCount);
+        swap(chunk.uvs, uvCount);
+        swap(chunk.normals, normalCount);
+        positionCount += chunk.positions;
+        uvCount += chunk.uvs;
+        normalCount += chunk.normals;
+    }
+
+    // Pass 2: parse. Pass 3, once every attribute is in place: index the corners.
+    vector<float> positions(positionCount * 3), uvs(uvCount * 2), normals(normalCount * 3);
+    UParallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            parseObjChunk(chunks[i], positions, uvs, normals);
+    });
+    for (const ObjChunk& chunk : chunks)
+    {
+        if (chunk.error)
+        {
+            size_t line = count(text, chunk.begin, '\n') + chunk.errorLine;
+            cout << "Error: " << filename << " line " << line << ": " << chunk.error << endl;
+            return false;
+        }
+    }
+    UParallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            indexObjChunk(chunks[i], positions, uvs, normals);
+    });
+
+    // Concatenate, each chunk copies its own range
+    size_t vertexCount = 0, indexCount = 0;
+    for (ObjChunk& chunk : chunks)
+    {
+        chunk.firstVertex = vertexCount;
+        chunk.firstIndex = indexCount;
+        vertexCount += chunk.vertices.size() / 8;
+        indexCount += chunk.indices.size();
+    }
+    mesh.vertices.resize(vertexCount * 8);
+    mesh.indices.resize(indexCount);
+    UParallelFor(chunks.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            ObjChunk& chunk = chunks[i];
+            copy(chunk.vertices.begin(), chunk.vertices.end(), mesh.vertices.begin() + chunk.firstVertex * 8);
+            for (size_t j = 0; j < chunk.indices.size(); ++j)
+                mesh.indices[chunk.firstIndex + j] = GLuint(chunk.firstVertex) + chunk.indices[j];
+        }
+    });
+    mesh.hasNormals = normalCount > 0;
+    mesh.hasUvs = uvCount > 0;
+
+    if (mesh.indices.empty())
+    {
+        cout << "Error: " << filename << " has no faces" << endl;
+        return false;
+    }
+    reportImport(filename, mesh, start);
+    return true;
+}
+
+
+bool UImportGltf(const char* filename, ImportedMesh& mesh)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mesh = ImportedMesh();
+
+    GltfDocument document;
+    if (!document.Load(filename) || !document.Import(mesh))
+        return false;
+    if (mesh.indices.empty())
+    {
+        cout << "Error: " << filename << " has no triangles" << endl;
+        return false;
+    }
+    reportImport(filename, mesh, start);
+    return true;
+}
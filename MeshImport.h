@@ -0,0 +1,39 @@
+// MeshImport.h
+// Imports artist-authored meshes from Wavefront OBJ and glTF 2.0 (.gltf with
+// external or embedded buffers, and binary .glb). Files are memory mapped
+// and parsed on every hardware thread: OBJ text is cut into line aligned
+// chunks that are counted, parsed and indexed in parallel, glTF accessors
+// are converted in parallel slices. The result is interleaved in the 8 float
+// position/normal/uv layout the static geometry pool stores, with indices.
+//
+// glTF node transforms are not applied, every triangle primitive of every
+// mesh is imported in its own mesh space. Texture coordinates are flipped
+// to the bottom-left origin our flipped texture images use.
+
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <vector>
+
+#include "StaticGeometry.h"
+
+struct ImportedMesh
+{
+    std::vector<float> vertices;    // position 3, normal 3, uv 2
+    std::vector<GLuint> indices;    // triangles
+    bool hasNormals = false;        // false when the file had none (they are zero)
+    bool hasUvs = false;
+
+    size_t VertexCount() const { return vertices.size() / 8; }
+    // Layout for StaticGeometryPool::AddMesh, missing normals reported as absent
+    PoolVertexLayout Layout() const { return PoolVertexLayout{ 8, 0, hasNormals ? 3 : -1, 6 }; }
+};
+
+// Picks the importer from the extension (.obj, .gltf or .glb)
+bool UImportMesh(const char* filename, ImportedMesh& mesh);
+bool UImportObj(const char* filename, ImportedMesh& mesh);
+bool UImportGltf(const char* filename, ImportedMesh& mesh);
+
+#endif
@@ -0,0 +1,561 @@
+// MeshSimplify.cpp
+// Quadric error edge collapse, see MeshSimplify.h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Hash.h"
+#include "MeshSimplify.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const int FLOATS_PER_VERTEX = 8;
+    const GLuint EMPTY_SLOT = ~GLuint(0);
+
+    // Borders and seams resist moving away from their line this much more than a face does
+    const double EDGE_WEIGHT = 10.0;
+    // A collapse may turn a triangle's normal by at most about 75 degrees
+    const double MIN_NORMAL_COSINE = 0.25;
+    // A LOD is kept only if it has at most this share of its parent's triangles
+    const double LOD_MAX_KEPT = 0.85;
+
+    // What a position may do: MANIFOLD collapses anywhere, BORDER and SEAM
+    // only along their border or seam, LOCKED stays
+    enum VertexKind { KIND_MANIFOLD, KIND_BORDER, KIND_SEAM, KIND_LOCKED };
+
+    struct Vec3
+    {
+        double x, y, z;
+    };
+
+    Vec3 operator-(const Vec3& a, const Vec3& b) { return Vec3{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+    double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Vec3 cross(const Vec3& a, const Vec3& b) { return Vec3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    double length(const Vec3& a) { return sqrt(dot(a, a)); }
+
+    // Sum of weighted squared distances to planes, as a symmetric 4x4 matrix
+    struct Quadric
+    {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0;
+        double totalWeight = 0;     // summed plane weights
+
+        // Plane dot(n, p) + d = 0 with unit n
+        void AddPlane(const Vec3& n, double d, double weight)
+        {
+            totalWeight += weight;
+            a00 += weight * n.x * n.x; a01 += weight * n.x * n.y; a02 += weight * n.x * n.z;
+            a11 += weight * n.y * n.y; a12 += weight * n.y * n.z; a22 += weight * n.z * n.z;
+            b0 += weight * n.x * d; b1 += weight * n.y * d; b2 += weight * n.z * d;
+            c += weight * d * d;
+        }
+
+        Quadric& operator+=(const Quadric& q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+            totalWeight += q.totalWeight;
+            return *this;
+        }
+
+        double Error(const Vec3& p) const
+        {
+            double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                       2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                       2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return max(e, 0.0);
+        }
+
+        // Weighted mean squared distance to the planes, in squared mesh
+        // units whatever the weights and however many quadrics were merged
+        double MeanError(const Vec3& p) const
+        {
+            return totalWeight > 0.0 ? Error(p) / totalWeight : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        GLuint source;      // vertex
+        GLuint target;      // vertex
+        double cost;
+        double distance2;   // mean squared distance the collapse moves the surface
+    };
+
+    uint64_t edgeKey(GLuint a, GLuint b)
+    {
+        return (uint64_t(a) << 32) | b;
+    }
+
+    bool hasEdge(const vector<uint64_t>& sorted, GLuint a, GLuint b)
+    {
+        return binary_search(sorted.begin(), sorted.end(), edgeKey(a, b));
+    }
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+            : vertices(vertices), vertexCount(vertexCount), current(indices, indices + indexCount)
+        {
+            BuildPositions();
+            BuildQuadrics();
+        }
+
+        // Runs collapse passes until the target or until nothing can collapse
+        float Simplify(size_t targetIndexCount)
+        {
+            RemoveDegenerate();
+            while (current.size() > targetIndexCount)
+            {
+                BuildTopology();
+                if (!CollapsePass(targetIndexCount / 3))
+                    break;
+                RemoveDegenerate();
+            }
+            return float(sqrt(maxError));
+        }
+
+        const vector<GLuint>& Indices() const { return current; }
+
+    private:
+        Vec3 Position(GLuint vertex) const
+        {
+            const float* p = vertices + size_t(vertex) * FLOATS_PER_VERTEX;
+            return Vec3{ p[0], p[1], p[2] };
+        }
+
+        bool SamePosition(GLuint vertex, const float* position) const
+        {
+            const float* p = vertices + size_t(vertex) * FLOATS_PER_VERTEX;
+            return p[0] == position[0] && p[1] == position[1] && p[2] == position[2];
+        }
+
+        // Vertices with equal positions share one representative and form a
+        // ring through wedge
+        void BuildPositions()
+        {
+            positionOf.resize(vertexCount);
+            wedge.resize(vertexCount);
+
+            size_t capacity = 16;
+            while (capacity < vertexCount * 2)
+                capacity *= 2;
+            vector<GLuint> slots(capacity, EMPTY_SLOT);
+            for (GLuint v = 0; v < vertexCount; ++v)
+            {
+                float key[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    float coordinate = vertices[size_t(v) * FLOATS_PER_VERTEX + i];
+                    key[i] = coordinate == 0.0f ? 0.0f : coordinate;     // -0 is 0
+                }
+                size_t slot = size_t(UHashBytes(key, sizeof(key))) & (capacity - 1);
+                while (slots[slot] != EMPTY_SLOT && !SamePosition(slots[slot], key))
+                    slot = (slot + 1) & (capacity - 1);
+
+                if (slots[slot] == EMPTY_SLOT)
+                {
+                    slots[slot] = v;
+                    positionOf[v] = v;
+                    wedge[v] = v;
+                }
+                else
+                {
+                    GLuint first = slots[slot];
+                    positionOf[v] = first;
+                    wedge[v] = wedge[first];
+                    wedge[first] = v;
+                }
+            }
+        }
+
+        void BuildQuadrics()
+        {
+            quadrics.assign(vertexCount, Quadric());
+            for (size_t t = 0; t + 2 < current.size(); t += 3)
+            {
+                Vec3 p0 = Position(current[t]), p1 = Position(current[t + 1]), p2 = Position(current[t + 2]);
+                Vec3 normal = cross(p1 - p0, p2 - p0);
+                double area2 = length(normal);
+                if (area2 == 0.0)
+                    continue;
+                normal = Vec3{ normal.x / area2, normal.y / area2, normal.z / area2 };
+
+                Quadric face;
+                face.AddPlane(normal, -dot(normal, p0), area2 * 0.5);
+                for (int i = 0; i < 3; ++i)
+                    quadrics[positionOf[current[t + i]]] += face;
+            }
+
+            // Planes through border and seam edges, perpendicular to their
+            // face, keep those edges from moving sideways
+            BuildTopology();
+            for (size_t t = 0; t + 2 < current.size(); t += 3)
+            {
+                Vec3 p[3] = { Position(current[t]), Position(current[t + 1]), Position(current[t + 2]) };
+                Vec3 normal = cross(p[1] - p[0], p[2] - p[0]);
+                if (length(normal) == 0.0)
+                    continue;
+                for (int e = 0; e < 3; ++e)
+                {
+                    GLuint a = current[t + e], b = current[t + (e + 1) % 3];
+                    if (!IsBorderEdge(a, b) && !IsSeamEdge(a, b))
+                        continue;
+                    Vec3 edge = p[(e + 1) % 3] - p[e];
+                    Vec3 side = cross(edge, normal);
+                    double sideLength = length(side);
+                    if (sideLength == 0.0)
+                        continue;
+                    side = Vec3{ side.x / sideLength, side.y / sideLength, side.z / sideLength };
+
+                    Quadric constraint;
+                    constraint.AddPlane(side, -dot(side, p[e]), dot(edge, edge) * EDGE_WEIGHT);
+                    quadrics[positionOf[a]] += constraint;
+                    quadrics[positionOf[b]] += constraint;
+                }
+            }
+        }
+
+        // Half-edges by vertex and by position, and each position's kind, for the current triangles
+        void BuildTopology()
+        {
+            vertexEdges.clear();
+            positionEdges.clear();
+            for (size_t t = 0; t + 2 < current.size(); t += 3)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    GLuint a = current[t + e], b = current[t + (e + 1) % 3];
+                    vertexEdges.push_back(edgeKey(a, b));
+                    positionEdges.push_back(edgeKey(positionOf[a], positionOf[b]));
+                }
+            }
+            sort(vertexEdges.begin(), vertexEdges.end());
+            sort(positionEdges.begin(), positionEdges.end());
+
+            // Per vertex: referenced, border and seam half-edges in and out
+            referenced.assign(vertexCount, 0);
+            borderOut.assign(vertexCount, 0);
+            borderIn.assign(vertexCount, 0);
+            seamOut.assign(vertexCount, 0);
+            seamIn.assign(vertexCount, 0);
+            for (size_t t = 0; t + 2 < current.size(); t += 3)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    GLuint a = current[t + e], b = current[t + (e + 1) % 3];
+                    referenced[a] = 1;
+                    if (!hasEdge(positionEdges, positionOf[b], positionOf[a]))
+                    {
+                        ++borderOut[a];
+                        ++borderIn[b];
+                    }
+                    else if (!hasEdge(vertexEdges, b, a))
+                    {
+                        ++seamOut[a];
+                        ++seamIn[b];
+                    }
+                }
+            }
+
+            kinds.assign(vertexCount, KIND_LOCKED);
+            for (GLuint v = 0; v < vertexCount; ++v)
+            {
+                if (positionOf[v] != v)
+                    continue;
+
+                int wedges = 0;
+                int borders = 0, seamErrors = 0;
+                bool simpleBorder = true;
+                GLuint w = v;
+                do
+                {
+                    if (referenced[w])
+                    {
+                        ++wedges;
+                        borders += borderOut[w] + borderIn[w];
+                        simpleBorder = simpleBorder && borderOut[w] == 1 && borderIn[w] == 1;
+                        seamErrors += (seamOut[w] != 1 || seamIn[w] != 1) ? 1 : 0;
+                    }
+                    w = wedge[w];
+                } while (w != v);
+
+                VertexKind kind = KIND_LOCKED;
+                if (wedges == 1 && borders == 0 && seamOut[FirstReferenced(v)] == 0 && seamIn[FirstReferenced(v)] == 0)
+                    kind = KIND_MANIFOLD;
+                else if (wedges == 1 && simpleBorder && seamOut[FirstReferenced(v)] == 0 && seamIn[FirstReferenced(v)] == 0)
+                    kind = KIND_BORDER;
+                else if (wedges == 2 && borders == 0 && seamErrors == 0)
+                    kind = KIND_SEAM;
+                kinds[v] = kind;
+            }
+        }
+
+        GLuint FirstReferenced(GLuint position) const
+        {
+            GLuint w = position;
+            do
+            {
+                if (referenced[w])
+                    return w;
+                w = wedge[w];
+            } while (w != position);
+            return position;
+        }
+
+        bool IsBorderEdge(GLuint a, GLuint b) const
+        {
+            GLuint pa = positionOf[a], pb = positionOf[b];
+            return hasEdge(positionEdges, pa, pb) != hasEdge(positionEdges, pb, pa);
+        }
+
+        bool IsSeamEdge(GLuint a, GLuint b) const
+        {
+            GLuint pa = positionOf[a], pb = positionOf[b];
+            return hasEdge(positionEdges, pa, pb) && hasEdge(positionEdges, pb, pa) &&
+                   !(hasEdge(vertexEdges, a, b) && hasEdge(vertexEdges, b, a));
+        }
+
+        bool CanCollapse(GLuint source, GLuint target) const
+        {
+            VertexKind sourceKind = kinds[positionOf[source]];
+            VertexKind targetKind = kinds[positionOf[target]];
+            switch (sourceKind)
+            {
+            case KIND_MANIFOLD:
+                return true;
+            case KIND_BORDER:
+                return IsBorderEdge(source, target) && (targetKind == KIND_BORDER || targetKind == KIND_LOCKED);
+            case KIND_SEAM:
+                return IsSeamEdge(source, target) && (targetKind == KIND_SEAM || targetKind == KIND_LOCKED);
+            default:
+                return false;
+            }
+        }
+
+        // The other side of a seam collapse: the source's second vertex goes
+        // to the target position's vertex it shares an edge with
+        bool SeamPartner(GLuint source, GLuint target, GLuint& partnerSource, GLuint& partnerTarget) const
+        {
+            partnerSource = wedge[source];
+            while (!referenced[partnerSource] && partnerSource != source)
+                partnerSource = wedge[partnerSource];
+            if (partnerSource == source)
+                return false;
+
+            GLuint w = target;
+            do
+            {
+                if (w != target && referenced[w] &&
+                    (hasEdge(vertexEdges, partnerSource, w) || hasEdge(vertexEdges, w, partnerSource)))
+                {
+                    partnerTarget = w;
+                    return true;
+                }
+                w = wedge[w];
+            } while (w != target);
+            return false;
+        }
+
+        // Triangles around each position, for flip checks and triangle counts
+        void BuildAdjacency()
+        {
+            adjacencyStart.assign(vertexCount + 1, 0);
+            for (GLuint v : current)
+                ++adjacencyStart[positionOf[v] + 1];
+            for (size_t i = 0; i < vertexCount; ++i)
+                adjacencyStart[i + 1] += adjacencyStart[i];
+            adjacency.resize(current.size());
+            vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < current.size(); ++i)
+                adjacency[fill[positionOf[current[i]]]++] = GLuint(i / 3);
+        }
+
+        bool Flips(GLuint sourcePosition, GLuint targetPosition) const
+        {
+            Vec3 moved = Position(targetPosition);
+            for (size_t i = adjacencyStart[sourcePosition]; i < adjacencyStart[sourcePosition + 1]; ++i)
+            {
+                size_t t = size_t(adjacency[i]) * 3;
+                GLuint p[3] = { positionOf[current[t]], positionOf[current[t + 1]], positionOf[current[t + 2]] };
+                if (p[0] == targetPosition || p[1] == targetPosition || p[2] == targetPosition)
+                    continue;   // collapses away
+
+                Vec3 before[3], after[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    before[k] = Position(p[k]);
+                    after[k] = p[k] == sourcePosition ? moved : before[k];
+                }
+                Vec3 n0 = cross(before[1] - before[0], before[2] - before[0]);
+                Vec3 n1 = cross(after[1] - after[0], after[2] - after[0]);
+                if (dot(n0, n1) <= MIN_NORMAL_COSINE * length(n0) * length(n1))
+                    return true;
+            }
+            return false;
+        }
+
+        // One round of independent collapses, cheapest first. Positions
+        // around a collapse are not touched again until the next round, so
+        // every flip check sees the geometry it guards.
+        bool CollapsePass(size_t targetTriangles)
+        {
+            BuildAdjacency();
+
+            // Each edge once, in its cheaper allowed direction
+            vector<Collapse> candidates;
+            candidates.reserve(current.size());
+            for (size_t t = 0; t + 2 < current.size(); t += 3)
+            {
+                for (int e = 0; e < 3; ++e)
+                {
+                    GLuint a = current[t + e], b = current[t + (e + 1) % 3];
+                    GLuint pa = positionOf[a], pb = positionOf[b];
+                    // the opposite half-edge, if any, offers the same edge
+                    if (pa > pb && hasEdge(positionEdges, pb, pa))
+                        continue;
+
+                    Quadric merged = quadrics[pa];
+                    merged += quadrics[pb];
+                    Collapse best = { 0, 0, -1.0, 0.0 };
+                    if (CanCollapse(a, b))
+                        best = Collapse{ a, b, merged.Error(Position(b)), merged.MeanError(Position(b)) };
+                    if (CanCollapse(b, a))
+                    {
+                        double cost = merged.Error(Position(a));
+                        if (best.cost < 0.0 || cost < best.cost)
+                            best = Collapse{ b, a, cost, merged.MeanError(Position(a)) };
+                    }
+                    if (best.cost >= 0.0)
+                        candidates.push_back(best);
+                }
+            }
+            sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+            collapseTo.resize(vertexCount);
+            for (GLuint v = 0; v < vertexCount; ++v)
+                collapseTo[v] = v;
+            touched.assign(vertexCount, 0);
+
+            size_t triangles = current.size() / 3;
+            size_t collapsed = 0;
+            for (const Collapse& collapse : candidates)
+            {
+                if (triangles <= targetTriangles)
+                    break;
+                GLuint pa = positionOf[collapse.source], pb = positionOf[collapse.target];
+                if (touched[pa] || touched[pb] || Flips(pa, pb))
+                    continue;
+
+                GLuint partnerSource = 0, partnerTarget = 0;
+                bool seam = kinds[pa] == KIND_SEAM;
+                if (seam && !SeamPartner(collapse.source, collapse.target, partnerSource, partnerTarget))
+                    continue;
+
+                collapseTo[collapse.source] = collapse.target;
+                if (seam)
+                    collapseTo[partnerSource] = partnerTarget;
+                quadrics[pb] += quadrics[pa];
+                maxError = max(maxError, collapse.distance2);
+                ++collapsed;
+
+                // Triangles on the collapsed edge disappear, the rest around pa change
+                for (size_t i = adjacencyStart[pa]; i < adjacencyStart[pa + 1]; ++i)
+                {
+                    size_t t = size_t(adjacency[i]) * 3;
+                    bool onEdge = false;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        GLuint p = positionOf[current[t + k]];
+                        onEdge = onEdge || p == pb;
+                        touched[p] = 1;
+                    }
+                    if (onEdge)
+                        --triangles;
+                }
+                touched[pb] = 1;
+            }
+
+            if (!collapsed)
+                return false;
+            for (GLuint& v : current)
+                v = collapseTo[v];
+            return true;
+        }
+
+        // Drops triangles with two corners at one position
+        void RemoveDegenerate()
+        {
+            size_t kept = 0;
+            for (size_t t = 0; t + 2 < current.size(); t += 3)
+            {
+                GLuint a = current[t], b = current[t + 1], c = current[t + 2];
+                GLuint pa = positionOf[a], pb = positionOf[b], pc = positionOf[c];
+                if (pa == pb || pb == pc || pa == pc)
+                    continue;
+                current[kept++] = a;
+                current[kept++] = b;
+                current[kept++] = c;
+            }
+            current.resize(kept);
+        }
+
+        const float* vertices;
+        size_t vertexCount;
+        vector<GLuint> current;
+
+        vector<GLuint> positionOf;      // vertex -> first vertex with the same position
+        vector<GLuint> wedge;           // ring of vertices sharing a position
+        vector<Quadric> quadrics;       // per position
+        double maxError = 0.0;          // squared mesh units
+
+        vector<uint64_t> vertexEdges;   // sorted half-edges
+        vector<uint64_t> positionEdges;
+        vector<unsigned char> referenced;
+        vector<unsigned short> borderOut, borderIn, seamOut, seamIn;
+        vector<VertexKind> kinds;       // per position
+
+        vector<size_t> adjacencyStart;  // per position, into adjacency
+        vector<GLuint> adjacency;       // triangle numbers
+        vector<GLuint> collapseTo;
+        vector<unsigned char> touched;
+    };
+}
+
+
+float USimplifyMesh(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                    size_t targetIndexCount, vector<GLuint>& simplified)
+{
+    Simplifier simplifier(vertices, vertexCount, indices, indexCount - indexCount % 3);
+    float error = simplifier.Simplify(targetIndexCount);
+    simplified = simplifier.Indices();
+    return error;
+}
+
+
+void UBuildLodChain(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                    int maxLods, vector<GLuint>& lodIndices, vector<MeshLod>& lods)
+{
+    lods.push_back(MeshLod{ lodIndices.size(), indexCount, 0.0f });
+    lodIndices.insert(lodIndices.end(), indices, indices + indexCount);
+
+    vector<GLuint> previous(indices, indices + indexCount), next;
+    float error = 0.0f;
+    for (int level = 1; level < maxLods; ++level)
+    {
+        size_t target = previous.size() / 6 * 3;
+        float levelError = USimplifyMesh(vertices, vertexCount, previous.data(), previous.size(), target, next);
+        if (next.empty() || next.size() > previous.size() * LOD_MAX_KEPT)
+            break;
+
+        // Each level simplifies the previous one, so their errors add up
+        error += levelError;
+        lods.push_back(MeshLod{ lodIndices.size(), next.size(), error });
+        lodIndices.insert(lodIndices.end(), next.begin(), next.end());
+        previous.swap(next);
+    }
+}
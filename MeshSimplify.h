@@ -0,0 +1,45 @@
+// MeshSimplify.h
+// Mesh simplification for levels of detail. Edges are collapsed in order of
+// their quadric error (the summed squared distance to the planes of the
+// triangles that met at the removed vertex), always onto an existing
+// vertex, so a simplified mesh is a new index list over the same vertices.
+//
+// Vertices are in the pool layout (position, normal, uv: 8 floats). Where
+// one position has several vertices (a UV seam or a hard normal edge) the
+// seam only collapses along itself, with both sides moving together, and
+// open borders only collapse along the border, so neither tears. Collapses
+// that would flip a triangle are skipped.
+
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstddef>
+#include <vector>
+
+// Levels in a chain, the full mesh included
+const int MESH_MAX_LODS = 4;
+
+// Simplifies the triangle list to about targetIndexCount indices (more when
+// every remaining collapse is blocked). Returns the error in mesh units:
+// the largest distance any collapse moved the surface, measured as the root
+// of the weighted mean squared distance to the planes the vertex carried.
+float USimplifyMesh(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                    size_t targetIndexCount, std::vector<GLuint>& simplified);
+
+// One level in a chain of LODs: a range of the chain's index list
+struct MeshLod
+{
+    size_t firstIndex;
+    size_t indexCount;
+    float error;            // mesh units, 0 for the full mesh
+};
+
+// Appends levels of detail to lodIndices and lods: the full mesh, then
+// each level halving the triangles of the previous one, up to maxLods in
+// total. Stops early when a level would remove too little to be worth it.
+void UBuildLodChain(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                    int maxLods, std::vector<GLuint>& lodIndices, std::vector<MeshLod>& lods);
+
+#endif
@@ -0,0 +1,56 @@
+// MeshWeld.cpp
+// Vertex welding, see MeshWeld.h
+
+#include <cstring>
+
+#include "Hash.h"
+#include "MeshWeld.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const GLuint EMPTY_SLOT = ~GLuint(0);
+
+    // -0 and 0 are the same coordinate but differ in their bits
+    inline float canonical(float value)
+    {
+        return value == 0.0f ? 0.0f : value;
+    }
+}
+
+
+size_t UWeldVertices(const float* vertices, size_t count, int stride, vector<float>& unique, vector<GLuint>& indices)
+{
+    size_t firstFloat = unique.size();
+    size_t vertexBytes = sizeof(float) * stride;
+
+    // Open addressing table of unique vertex numbers, at most half full
+    size_t capacity = 16;
+    while (capacity < count * 2)
+        capacity *= 2;
+    vector<GLuint> slots(capacity, EMPTY_SLOT);
+
+    vector<float> key(stride);
+    GLuint uniqueCount = 0;
+    indices.reserve(indices.size() + count);
+    for (size_t v = 0; v < count; ++v)
+    {
+        const float* vertex = vertices + v * stride;
+        for (int i = 0; i < stride; ++i)
+            key[i] = canonical(vertex[i]);
+
+        size_t slot = size_t(UHashBytes(key.data(), vertexBytes)) & (capacity - 1);
+        while (slots[slot] != EMPTY_SLOT &&
+               memcmp(&unique[firstFloat + size_t(slots[slot]) * stride], key.data(), vertexBytes) != 0)
+            slot = (slot + 1) & (capacity - 1);
+
+        if (slots[slot] == EMPTY_SLOT)
+        {
+            slots[slot] = uniqueCount++;
+            unique.insert(unique.end(), key.begin(), key.end());
+        }
+        indices.push_back(slots[slot]);
+    }
+    return uniqueCount;
+}
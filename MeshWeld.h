@@ -0,0 +1,21 @@
+// MeshWeld.h
+// Turns an unindexed triangle list into unique vertices plus indices.
+// Vertices are compared on every float they carry (position, normal and
+// texture coordinate alike), so only exact duplicates merge and the mesh
+// looks the same drawn indexed.
+
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstddef>
+#include <vector>
+
+// Appends the unique vertices of count vertices of stride floats to unique
+// and one index per input vertex (relative to the first appended vertex) to
+// indices. Returns the number of unique vertices.
+size_t UWeldVertices(const float* vertices, size_t count, int stride,
+                     std::vector<float>& unique, std::vector<GLuint>& indices);
+
+#endif
@@ -0,0 +1,256 @@
+// Meshlet.cpp
+// Meshlet building and cone culling, see Meshlet.h
+
+#include <algorithm>
+#include <cmath>            // sqrt
+#include <iostream>         // cout, cerr
+
+#include "Meshlet.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const size_t FLOATS_PER_VERTEX = 8;
+    // Below this cosine between the axis and the widest normal the cone is
+    // too open to ever cull (about 84 degrees)
+    const float MIN_CONE_COSINE = 0.1f;
+    const size_t NONE = size_t(-1);
+
+    glm::vec3 position(const float* vertices, GLuint vertex)
+    {
+        const float* v = vertices + vertex * FLOATS_PER_VERTEX;
+        return glm::vec3(v[0], v[1], v[2]);
+    }
+
+    // The meshlet's triangles as a range of meshletIndices, with its bounds
+    Meshlet finishMeshlet(const float* vertices, const GLuint* indices, const vector<GLuint>& triangles,
+                          const vector<glm::vec3>& normals, vector<GLuint>& meshletIndices)
+    {
+        Meshlet meshlet;
+        meshlet.firstIndex = (GLuint)meshletIndices.size();
+        meshlet.indexCount = (GLuint)(triangles.size() * 3);
+
+        glm::vec3 low(position(vertices, indices[triangles[0] * 3]));
+        glm::vec3 high(low);
+        glm::vec3 normalSum(0.0f);
+        for (GLuint triangle : triangles)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                GLuint vertex = indices[triangle * 3 + corner];
+                meshletIndices.push_back(vertex);
+                low = glm::min(low, position(vertices, vertex));
+                high = glm::max(high, position(vertices, vertex));
+            }
+            normalSum += normals[triangle];
+        }
+
+        // Sphere around the box center; not the tightest, but cheap and close for small patches
+        meshlet.center = (low + high) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (GLuint triangle : triangles)
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                glm::vec3 offset = position(vertices, indices[triangle * 3 + corner]) - meshlet.center;
+                radiusSquared = max(radiusSquared, glm::dot(offset, offset));
+            }
+        meshlet.radius = sqrt(radiusSquared);
+
+        // The cone's half angle is set by the normal furthest from the axis;
+        // degenerate triangles (zero normal) never draw and are ignored
+        float axisLength = glm::length(normalSum);
+        meshlet.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minCosine = axisLength > 0.0f ? 1.0f : -1.0f;
+        for (GLuint triangle : triangles)
+            if (glm::dot(normals[triangle], normals[triangle]) > 0.0f)
+                minCosine = min(minCosine, glm::dot(meshlet.coneAxis, normals[triangle]));
+        meshlet.coneCutoff = minCosine <= MIN_CONE_COSINE ? 1.0f : sqrt(1.0f - minCosine * minCosine);
+        return meshlet;
+    }
+}
+
+
+void UBuildMeshlets(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                    size_t maxTriangles, vector<Meshlet>& meshlets, vector<GLuint>& meshletIndices)
+{
+    meshlets.clear();
+    meshletIndices.clear();
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+        return;
+    maxTriangles = max<size_t>(maxTriangles, 1);
+    meshletIndices.reserve(triangleCount * 3);
+
+    // Facing and centroid of every triangle
+    vector<glm::vec3> normals(triangleCount);
+    vector<glm::vec3> centroids(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        glm::vec3 a = position(vertices, indices[t * 3]);
+        glm::vec3 b = position(vertices, indices[t * 3 + 1]);
+        glm::vec3 c = position(vertices, indices[t * 3 + 2]);
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        centroids[t] = (a + b + c) / 3.0f;
+    }
+
+    // Triangles around each vertex, packed by vertex
+    vector<GLuint> firstAdjacent(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        ++firstAdjacent[indices[i] + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+        firstAdjacent[v + 1] += firstAdjacent[v];
+    vector<GLuint> adjacent(triangleCount * 3);
+    vector<GLuint> filled(firstAdjacent.begin(), firstAdjacent.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i)
+        adjacent[filled[indices[i]]++] = GLuint(i / 3);
+
+    vector<char> emitted(triangleCount, 0);
+    vector<GLuint> candidateOf(triangleCount, 0);  // meshlet number + 1 that listed the triangle
+    vector<GLuint> triangles;
+    vector<GLuint> candidates;
+    size_t scan = 0;
+    size_t seed = NONE;
+    size_t remaining = triangleCount;
+
+    while (remaining > 0)
+    {
+        // Continue next to the previous meshlet, so neighbours stay close in the index list
+        if (seed == NONE || emitted[seed])
+        {
+            while (emitted[scan])
+                ++scan;
+            seed = scan;
+        }
+
+        GLuint stamp = GLuint(meshlets.size() + 1);
+        glm::vec3 normalSum(0.0f);
+        glm::vec3 centroidSum(0.0f);
+        triangles.clear();
+        candidates.clear();
+
+        size_t next = seed;
+        while (true)
+        {
+            emitted[next] = 1;
+            --remaining;
+            triangles.push_back(GLuint(next));
+            normalSum += normals[next];
+            centroidSum += centroids[next];
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                GLuint vertex = indices[next * 3 + corner];
+                for (GLuint a = firstAdjacent[vertex]; a < firstAdjacent[vertex + 1]; ++a)
+                {
+                    GLuint neighbour = adjacent[a];
+                    if (!emitted[neighbour] && candidateOf[neighbour] != stamp)
+                    {
+                        candidateOf[neighbour] = stamp;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+            if (triangles.size() >= maxTriangles)
+                break;
+
+            // Closest to the meshlet's middle, weighted up when it faces away from the rest
+            float axisLength = glm::length(normalSum);
+            glm::vec3 axis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f);
+            glm::vec3 middle = centroidSum / float(triangles.size());
+            size_t best = NONE;
+            float bestScore = 0.0f;
+            for (size_t c = 0; c < candidates.size(); )
+            {
+                GLuint candidate = candidates[c];
+                if (emitted[candidate])
+                {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                float score = glm::distance(centroids[candidate], middle) * (2.0f - glm::dot(normals[candidate], axis));
+                if (best == NONE || score < bestScore)
+                {
+                    best = c;
+                    bestScore = score;
+                }
+                ++c;
+            }
+            if (best == NONE)
+                break;
+            next = candidates[best];
+            candidates[best] = candidates.back();
+            candidates.pop_back();
+        }
+
+        meshlets.push_back(finishMeshlet(vertices, indices, triangles, normals, meshletIndices));
+
+        seed = NONE;
+        for (GLuint candidate : candidates)
+            if (!emitted[candidate])
+            {
+                seed = candidate;
+                break;
+            }
+    }
+}
+
+
+bool UMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& cameraPosition)
+{
+    // Every normal is within the cone, so every triangle faces away when the
+    // whole sphere lies behind the plane the cone's widest normal allows
+    glm::vec3 toMeshlet = meshlet.center - cameraPosition;
+    return glm::dot(toMeshlet, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toMeshlet) + meshlet.radius;
+}
+
+
+void MeshletMesh::Build(const float* vertices, size_t vertexCount, const GLuint* sourceIndices, size_t indexCount,
+                        size_t maxTriangles)
+{
+    UBuildMeshlets(vertices, vertexCount, sourceIndices, indexCount, maxTriangles, meshlets, indices);
+    visible.clear();
+    visibleTriangles = 0;
+}
+
+
+void MeshletMesh::Cull(const glm::mat4& model, const glm::vec3& cameraPosition)
+{
+    // A uniform scale keeps the test's inequality, so the camera moves into
+    // mesh space instead of every meshlet moving into world space
+    glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+
+    visible.clear();
+    visibleTriangles = 0;
+    size_t visibleMeshlets = 0;
+    for (const Meshlet& meshlet : meshlets)
+    {
+        if (UMeshletBackfacing(meshlet, camera))
+            continue;
+        ++visibleMeshlets;
+        if (!visible.empty() && visible.back().firstIndex + visible.back().indexCount == meshlet.firstIndex)
+            visible.back().indexCount += meshlet.indexCount;
+        else
+            visible.push_back(MeshletRange{ meshlet.firstIndex, meshlet.indexCount });
+        visibleTriangles += meshlet.indexCount / 3;
+    }
+
+    ++culls;
+    meshletsTested += meshlets.size();
+    meshletsCulled += meshlets.size() - visibleMeshlets;
+    trianglesTested += indices.size() / 3;
+    trianglesCulled += indices.size() / 3 - visibleTriangles;
+}
+
+
+void MeshletMesh::PrintStats() const
+{
+    cout << "INFO: Meshlets: " << meshlets.size() << " meshlets over " << indices.size() / 3 << " triangles, ";
+    if (culls)
+        cout << culls << " culls removed " << 100.0 * meshletsCulled / meshletsTested << "% of meshlets, "
+             << 100.0 * trianglesCulled / trianglesTested << "% of triangles" << endl;
+    else
+        cout << "never culled" << endl;
+}
@@ -0,0 +1,89 @@
+// Meshlet.h
+// Meshes split into small clusters of neighbouring triangles (meshlets), each
+// with a bounding sphere and a cone holding every triangle normal. A meshlet
+// whose cone points away from the camera by more than its half angle faces
+// away as a whole and is skipped before it reaches the GPU; on a planet
+// seen close up that is most of the sphere.
+//
+// Meshlets are ranges of a reordered index list over the mesh's own
+// vertices, so a culled mesh is still one vertex range and one index range
+// (MeshHeap) and the visible meshlets draw with one glMultiDrawElementsIndirect.
+// Vertices are in the pool layout (position, normal, uv: 8 floats).
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Triangles per meshlet, small enough that the normal cones stay narrow
+const size_t MESHLET_MAX_TRIANGLES = 64;
+
+struct Meshlet
+{
+    GLuint firstIndex;      // into the reordered index list
+    GLuint indexCount;
+    glm::vec3 center;       // bounding sphere, mesh units
+    float radius;
+    glm::vec3 coneAxis;     // average facing of the triangles
+    float coneCutoff;       // sine of the cone's half angle, 1 when it cannot be culled
+};
+
+// Groups the triangles into meshlets of at most maxTriangles, growing each
+// from a seed through triangles that share a vertex with it and face the
+// same way. meshletIndices receives the triangles meshlet by meshlet.
+void UBuildMeshlets(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+                    size_t maxTriangles, std::vector<Meshlet>& meshlets, std::vector<GLuint>& meshletIndices);
+
+// True when no triangle of the meshlet can face a camera at cameraPosition
+// (same space as the meshlet)
+bool UMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& cameraPosition);
+
+// Part of a mesh's index list to draw
+struct MeshletRange
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+};
+
+// A mesh's meshlets and the ones left after culling a draw of it
+class MeshletMesh
+{
+public:
+    MeshletMesh() {}
+
+    // Splits the mesh. Indices() replaces the mesh's index list in its buffer.
+    void Build(const float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+               size_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+    // Keeps the meshlets of a draw at model that may face the camera, with
+    // neighbouring survivors merged into one range. Assumes model scales
+    // uniformly, so angles and spheres survive the transform.
+    void Cull(const glm::mat4& model, const glm::vec3& cameraPosition);
+
+    const std::vector<GLuint>& Indices() const { return indices; }
+    const std::vector<Meshlet>& Meshlets() const { return meshlets; }
+    const std::vector<MeshletRange>& Visible() const { return visible; }
+    size_t VisibleTriangles() const { return visibleTriangles; }
+
+    void PrintStats() const;
+
+private:
+    std::vector<Meshlet> meshlets;
+    std::vector<GLuint> indices;
+    std::vector<MeshletRange> visible;
+    size_t visibleTriangles = 0;
+
+    // stats over every Cull
+    unsigned long long culls = 0;
+    unsigned long long meshletsTested = 0;
+    unsigned long long meshletsCulled = 0;
+    unsigned long long trianglesTested = 0;
+    unsigned long long trianglesCulled = 0;
+};
+
+#endif
@@ -0,0 +1,475 @@
+// Mipmap.cpp
+// CPU mip chain builder, see Mipmap.h
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_USE_SSE2
+#endif
+
+#include <GL/glew.h>        // GLEW library
+
+#include "Mipmap.h"
+#include "Parallel.h"
+
+namespace
+{
+    const unsigned MIP_CACHE_MAGIC = 0x4350494D;   // "MIPC"
+    const unsigned MIP_CACHE_VERSION = 1;
+
+    // Rows per worker slice, keeps tiny levels on the calling thread
+    const size_t MIN_ROWS_PER_THREAD = 16;
+
+    // Kaiser filter parameters (8 taps for a 2:1 reduction)
+    const int KAISER_TAPS = 8;
+    const float KAISER_ALPHA = 4.0f;
+
+    // Size of the linear to sRGB lookup table
+    const int LINEAR_TABLE_SIZE = 4096;
+
+    // sRGB byte to linear float
+    const float* srgbToLinearTable()
+    {
+        static float table[256];
+        static bool initialized = false;
+        if (!initialized)
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                float c = i / 255.0f;
+                table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            initialized = true;
+        }
+        return table;
+    }
+
+    // Linear float (quantized to LINEAR_TABLE_SIZE steps) to sRGB byte
+    const unsigned char* linearToSrgbTable()
+    {
+        static unsigned char table[LINEAR_TABLE_SIZE];
+        static bool initialized = false;
+        if (!initialized)
+        {
+            for (int i = 0; i < LINEAR_TABLE_SIZE; ++i)
+            {
+                float l = i / float(LINEAR_TABLE_SIZE - 1);
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                table[i] = (unsigned char)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+            }
+            initialized = true;
+        }
+        return table;
+    }
+
+    bool isAlphaChannel(int channel, int channels)
+    {
+        return channels == 4 && channel == 3;
+    }
+
+    // Converts 8 bit pixels to linear floats
+    void toLinear(const unsigned char* src, float* dst, int width, int height, int channels)
+    {
+        const float* table = srgbToLinearTable();
+        UParallelFor(height, MIN_ROWS_PER_THREAD, [=](size_t begin, size_t end)
+        {
+            for (size_t y = begin; y < end; ++y)
+            {
+                size_t row = y * width * channels;
+                for (int i = 0; i < width * channels; ++i)
+                {
+                    unsigned char c = src[row + i];
+                    dst[row + i] = isAlphaChannel(i % channels, channels) ? c / 255.0f : table[c];
+                }
+            }
+        });
+    }
+
+    // Converts linear floats back to 8 bit pixels
+    void toSrgb(const float* src, unsigned char* dst, int width, int height, int channels)
+    {
+        const unsigned char* table = linearToSrgbTable();
+        UParallelFor(height, MIN_ROWS_PER_THREAD, [=](size_t begin, size_t end)
+        {
+            for (size_t y = begin; y < end; ++y)
+            {
+                size_t row = y * width * channels;
+                for (int i = 0; i < width * channels; ++i)
+                {
+                    float v = std::min(1.0f, std::max(0.0f, src[row + i]));
+                    dst[row + i] = isAlphaChannel(i % channels, channels)
+                        ? (unsigned char)(v * 255.0f + 0.5f)
+                        : table[(int)(v * (LINEAR_TABLE_SIZE - 1) + 0.5f)];
+                }
+            }
+        });
+    }
+
+    // out[i] = a[i] + b[i]
+    void addRows(const float* a, const float* b, float* out, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIPMAP_USE_SSE2
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+        for (; i < count; ++i)
+            out[i] = a[i] + b[i];
+    }
+
+    // out[i] += in[i] * weight
+    void addScaledRow(const float* in, float weight, float* out, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIPMAP_USE_SSE2
+        __m128 w = _mm_set1_ps(weight);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), w)));
+#endif
+        for (; i < count; ++i)
+            out[i] += in[i] * weight;
+    }
+
+    // out[i] = max(out[i], 0), the filters' negative lobes can undershoot
+    void clampRowToZero(float* out, size_t count)
+    {
+        size_t i = 0;
+#ifdef MIPMAP_USE_SSE2
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(out + i, _mm_max_ps(_mm_loadu_ps(out + i), _mm_setzero_ps()));
+#endif
+        for (; i < count; ++i)
+            out[i] = std::max(0.0f, out[i]);
+    }
+
+    // 2x2 box filter, odd edges are clamped
+    void downsampleBox(const float* src, int width, int height, float* dst, int dstWidth, int dstHeight, int channels)
+    {
+        UParallelFor(dstHeight, MIN_ROWS_PER_THREAD, [=](size_t begin, size_t end)
+        {
+            std::vector<float> sum(size_t(width) * channels);
+            for (size_t y = begin; y < end; ++y)
+            {
+                // An axis already at its minimum size is not reduced
+                int y0 = height == dstHeight ? int(y) : std::min(int(y) * 2, height - 1);
+                int y1 = height == dstHeight ? int(y) : std::min(int(y) * 2 + 1, height - 1);
+                const float* row0 = src + size_t(y0) * width * channels;
+                const float* row1 = src + size_t(y1) * width * channels;
+                addRows(row0, row1, sum.data(), sum.size());
+
+                float* out = dst + y * dstWidth * channels;
+                for (int x = 0; x < dstWidth; ++x)
+                {
+                    int x0 = (width == dstWidth ? x : std::min(x * 2, width - 1)) * channels;
+                    int x1 = (width == dstWidth ? x : std::min(x * 2 + 1, width - 1)) * channels;
+                    for (int c = 0; c < channels; ++c)
+                        out[x * channels + c] = (sum[x0 + c] + sum[x1 + c]) * 0.25f;
+                }
+            }
+        });
+    }
+
+    // Zeroth order modified Bessel function of the first kind
+    float besselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (int k = 1; k < 16; ++k)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Normalized Kaiser windowed sinc weights for a 2:1 reduction.
+    // Tap i samples source pixel 2 * x - KAISER_TAPS / 2 + 1 + i.
+    const float* kaiserWeights()
+    {
+        static float weights[KAISER_TAPS];
+        static bool initialized = false;
+        if (!initialized)
+        {
+            const float PI = 3.14159265f;
+            float total = 0.0f;
+            for (int i = 0; i < KAISER_TAPS; ++i)
+            {
+                // distance from the destination pixel centre in source pixels
+                float d = i - (KAISER_TAPS - 1) * 0.5f;
+                float x = d * 0.5f;
+                float sinc = std::fabs(x) < 1e-5f ? 1.0f : std::sin(PI * x) / (PI * x);
+                float t = d / (KAISER_TAPS * 0.5f);
+                float window = besselI0(KAISER_ALPHA * std::sqrt(std::max(0.0f, 1.0f - t * t))) / besselI0(KAISER_ALPHA);
+                weights[i] = sinc * window;
+                total += weights[i];
+            }
+            for (int i = 0; i < KAISER_TAPS; ++i)
+                weights[i] /= total;
+            initialized = true;
+        }
+        return weights;
+    }
+
+#ifdef MIPMAP_USE_SSE2
+    // One pixel of the horizontal Kaiser pass with its channels in one
+    // register; in points at the first tap. Reads 4 floats per tap, so with
+    // 3 channels the pixel after the last tap must exist too.
+    __m128 kaiserPixel(const float* in, int channels, const float* weights)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int i = 0; i < KAISER_TAPS; ++i)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(in + i * channels), _mm_set1_ps(weights[i])));
+        return _mm_max_ps(sum, _mm_setzero_ps());
+    }
+#endif
+
+    // Separable Kaiser filter: horizontal pass into tmp, then vertical pass into dst
+    void downsampleKaiser(const float* src, int width, int height, float* dst, int dstWidth, int dstHeight, int channels)
+    {
+        const float* weights = kaiserWeights();
+        std::vector<float> tmp(size_t(dstWidth) * height * channels);
+        float* tmpData = tmp.data();
+
+        UParallelFor(height, MIN_ROWS_PER_THREAD, [=](size_t begin, size_t end)
+        {
+            for (size_t y = begin; y < end; ++y)
+            {
+                const float* in = src + y * width * channels;
+                float* out = tmpData + y * dstWidth * channels;
+                if (width == dstWidth)
+                {
+                    std::copy(in, in + size_t(width) * channels, out);
+                    continue;
+                }
+                for (int x = 0; x < dstWidth; ++x)
+                {
+                    int firstTap = x * 2 - KAISER_TAPS / 2 + 1;
+#ifdef MIPMAP_USE_SSE2
+                    // Pixels away from the row's ends need no clamping
+                    if (firstTap >= 0 && firstTap + KAISER_TAPS + (channels == 3 ? 1 : 0) <= width)
+                    {
+                        __m128 v = kaiserPixel(in + firstTap * channels, channels, weights);
+                        if (channels == 4)
+                            _mm_storeu_ps(out + x * 4, v);
+                        else
+                        {
+                            // A 4 float store would reach into the next row, another thread's
+                            float pixel[4];
+                            _mm_storeu_ps(pixel, v);
+                            std::copy(pixel, pixel + 3, out + x * 3);
+                        }
+                        continue;
+                    }
+#endif
+                    for (int c = 0; c < channels; ++c)
+                    {
+                        float v = 0.0f;
+                        for (int i = 0; i < KAISER_TAPS; ++i)
+                        {
+                            int sx = std::min(width - 1, std::max(0, firstTap + i));
+                            v += in[sx * channels + c] * weights[i];
+                        }
+                        out[x * channels + c] = std::max(0.0f, v);
+                    }
+                }
+            }
+        });
+
+        UParallelFor(dstHeight, MIN_ROWS_PER_THREAD, [=](size_t begin, size_t end)
+        {
+            size_t rowSize = size_t(dstWidth) * channels;
+            for (size_t y = begin; y < end; ++y)
+            {
+                float* out = dst + y * rowSize;
+                if (height == dstHeight)
+                {
+                    std::copy(tmpData + y * rowSize, tmpData + (y + 1) * rowSize, out);
+                    continue;
+                }
+                std::fill(out, out + rowSize, 0.0f);
+                for (int i = 0; i < KAISER_TAPS; ++i)
+                {
+                    int sy = std::min(height - 1, std::max(0, int(y) * 2 - KAISER_TAPS / 2 + 1 + i));
+                    addScaledRow(tmpData + sy * rowSize, weights[i], out, rowSize);
+                }
+                clampRowToZero(out, rowSize);
+            }
+        });
+    }
+
+    // Size and modification time identify the version of the source image
+    bool sourceStamp(const char* filename, long long& size, long long& modified)
+    {
+#ifdef _WIN32
+        struct _stat64 info;
+        if (_stat64(filename, &info) != 0)
+            return false;
+#else
+        struct stat info;
+        if (stat(filename, &info) != 0)
+            return false;
+#endif
+        size = (long long)info.st_size;
+        modified = (long long)info.st_mtime;
+        return true;
+    }
+
+    template <typename T>
+    void writeValue(std::ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool readValue(std::ifstream& in, T& value)
+    {
+        return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+}
+
+
+bool UBuildMipChain(const unsigned char* image, int width, int height, int channels, MipFilter filter, MipChain& chain, int minSize)
+{
+    if (!image || width <= 0 || height <= 0 || minSize <= 0 || (channels != 3 && channels != 4))
+        return false;
+
+    chain.channels = channels;
+    chain.levels.clear();
+
+    // Level 0 is the source image untouched
+    MipLevel base;
+    base.width = width;
+    base.height = height;
+    base.pixels.assign(image, image + size_t(width) * height * channels);
+    chain.levels.push_back(std::move(base));
+
+    // Every further level is filtered from the previous one in linear space
+    std::vector<float> current(size_t(width) * height * channels);
+    toLinear(image, current.data(), width, height, channels);
+
+    int w = width;
+    int h = height;
+    while (w > minSize || h > minSize)
+    {
+        int nextWidth = w > minSize ? std::max(minSize, w / 2) : w;
+        int nextHeight = h > minSize ? std::max(minSize, h / 2) : h;
+        std::vector<float> next(size_t(nextWidth) * nextHeight * channels);
+
+        if (filter == MIP_FILTER_KAISER)
+            downsampleKaiser(current.data(), w, h, next.data(), nextWidth, nextHeight, channels);
+        else
+            downsampleBox(current.data(), w, h, next.data(), nextWidth, nextHeight, channels);
+
+        MipLevel level;
+        level.width = nextWidth;
+        level.height = nextHeight;
+        level.pixels.resize(next.size());
+        toSrgb(next.data(), level.pixels.data(), nextWidth, nextHeight, channels);
+        chain.levels.push_back(std::move(level));
+
+        current.swap(next);
+        w = nextWidth;
+        h = nextHeight;
+    }
+
+    return true;
+}
+
+
+bool USaveMipChain(const char* cacheFilename, const char* sourceFilename, const MipChain& chain)
+{
+    long long size, modified;
+    if (!sourceStamp(sourceFilename, size, modified))
+        return false;
+
+    std::ofstream out(cacheFilename, std::ios::binary);
+    if (!out)
+        return false;
+
+    writeValue(out, MIP_CACHE_MAGIC);
+    writeValue(out, MIP_CACHE_VERSION);
+    writeValue(out, size);
+    writeValue(out, modified);
+    writeValue(out, chain.channels);
+    writeValue(out, (int)chain.levels.size());
+    for (const MipLevel& level : chain.levels)
+    {
+        writeValue(out, level.width);
+        writeValue(out, level.height);
+        out.write(reinterpret_cast<const char*>(level.pixels.data()), level.pixels.size());
+    }
+
+    return bool(out);
+}
+
+
+bool ULoadMipChain(const char* cacheFilename, const char* sourceFilename, MipChain& chain)
+{
+    long long size, modified;
+    if (!sourceStamp(sourceFilename, size, modified))
+        return false;
+
+    std::ifstream in(cacheFilename, std::ios::binary);
+    if (!in)
+        return false;
+
+    unsigned magic, version;
+    long long cachedSize, cachedModified;
+    int channels, levelCount;
+    if (!readValue(in, magic) || !readValue(in, version) || magic != MIP_CACHE_MAGIC || version != MIP_CACHE_VERSION)
+        return false;
+    if (!readValue(in, cachedSize) || !readValue(in, cachedModified) || cachedSize != size || cachedModified != modified)
+        return false;
+    if (!readValue(in, channels) || !readValue(in, levelCount) || (channels != 3 && channels != 4) || levelCount <= 0 || levelCount > 32)
+        return false;
+
+    chain.channels = channels;
+    chain.levels.resize(levelCount);
+    for (MipLevel& level : chain.levels)
+    {
+        if (!readValue(in, level.width) || !readValue(in, level.height) || level.width <= 0 || level.height <= 0)
+            return false;
+        level.pixels.resize(size_t(level.width) * level.height * channels);
+        if (!in.read(reinterpret_cast<char*>(level.pixels.data()), level.pixels.size()))
+            return false;
+    }
+
+    return true;
+}
+
+
+bool UUploadMipChain(const MipChain& chain)
+{
+    GLenum internalFormat, format;
+    if (chain.channels == 3)
+    {
+        internalFormat = GL_RGB8;
+        format = GL_RGB;
+    }
+    else if (chain.channels == 4)
+    {
+        internalFormat = GL_RGBA8;
+        format = GL_RGBA;
+    }
+    else
+        return false;
+
+    // Rows are tightly packed, and RGB levels narrower than 4 pixels are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < chain.levels.size(); ++i)
+    {
+        const MipLevel& level = chain.levels[i];
+        glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, level.pixels.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)chain.levels.size() - 1);
+
+    return true;
+}
@@ -0,0 +1,45 @@
+// Mipmap.h
+// CPU mip chain builder used in place of glGenerateMipmap.
+// Levels are filtered in linear space on worker threads, can be cached
+// to disk next to the source image and are uploaded level by level.
+
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <vector>
+
+// Downsampling filters for building the chain
+enum MipFilter
+{
+    MIP_FILTER_BOX,     // 2x2 average, fastest
+    MIP_FILTER_KAISER   // 8 tap Kaiser windowed sinc, sharper
+};
+
+// A single level of 8 bit sRGB pixels, rows tightly packed
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+// Every level from full resolution down to 1x1
+struct MipChain
+{
+    int channels = 0;
+    std::vector<MipLevel> levels;
+};
+
+// Builds the full chain from an 8 bit image (3 or 4 channels, alpha is kept linear).
+// Each axis stops halving at minSize, and the chain ends once both have reached it.
+bool UBuildMipChain(const unsigned char* image, int width, int height, int channels, MipFilter filter, MipChain& chain, int minSize = 1);
+
+// Cache files remember the size and modification time of the source image,
+// so loading fails (and the caller rebuilds) when the source has changed
+bool USaveMipChain(const char* cacheFilename, const char* sourceFilename, const MipChain& chain);
+bool ULoadMipChain(const char* cacheFilename, const char* sourceFilename, MipChain& chain);
+
+// Uploads every level into the currently bound GL_TEXTURE_2D
+bool UUploadMipChain(const MipChain& chain);
+
+#endif
@@ -0,0 +1,243 @@
+// Occlusion.cpp
+// Hierarchical depth occlusion culling, see Occlusion.h
+
+#include <algorithm>
+#include <iostream>         // cout, cerr
+
+#include "Occlusion.h"
+#include "RenderState.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Workgroup sizes of occlusion_cull.comp and hiz.comp
+    const GLuint CULL_GROUP_SIZE = 64;
+    const GLuint PYRAMID_GROUP_SIZE = 8;
+    // DrawElementsIndirectCommand
+    const size_t COMMAND_SIZE = 5 * sizeof(GLuint);
+    // tested, outside the frustum, occluded, drawn by phase 1, drawn by phase 2
+    const int STAT_COUNT = 5;
+
+    // Largest power of two not above value
+    int previousPowerOfTwo(int value)
+    {
+        int power = 1;
+        while (power * 2 <= value)
+            power *= 2;
+        return power;
+    }
+
+    GLuint groups(int size, GLuint groupSize)
+    {
+        return (GLuint(size) + groupSize - 1) / groupSize;
+    }
+}
+
+
+bool OcclusionCuller::Create(const vector<Aabb>& boxes, GLuint commandBuffer, size_t commands)
+{
+    Destroy();
+    objectCount = boxes.size();
+    commandCount = min(commands, objectCount);
+    sourceBuffer = commandBuffer;
+
+    // Boxes as min, max pairs of vec4 (std430 pads vec3 to 16 bytes anyway)
+    vector<glm::vec4> bounds;
+    bounds.reserve(objectCount * 2);
+    for (const Aabb& box : boxes)
+    {
+        bounds.push_back(glm::vec4(box.min, 1.0f));
+        bounds.push_back(glm::vec4(box.max, 1.0f));
+    }
+    glGenBuffers(1, &objectBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(bounds.size(), 1) * sizeof(glm::vec4), bounds.data(), GL_DYNAMIC_DRAW);
+
+    // Everything counts as visible before the first frame, so phase 1 draws it all once
+    vector<GLuint> visible(max<size_t>(objectCount, 1), 1);
+    glGenBuffers(1, &visibilityBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, visible.size() * sizeof(GLuint), visible.data(), GL_DYNAMIC_COPY);
+
+    glGenBuffers(2, phaseBuffers);
+    for (GLuint buffer : phaseBuffers)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, max<size_t>(commandCount, 1) * COMMAND_SIZE, nullptr, GL_DYNAMIC_COPY);
+    }
+
+    GLuint zeros[STAT_COUNT] = {};
+    glGenBuffers(1, &statsBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), zeros, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cout << "INFO: Occlusion culling: " << objectCount << " objects, " << commandCount << " of them indirect draws" << endl;
+    return true;
+}
+
+
+void OcclusionCuller::Destroy()
+{
+    DestroyPyramid();
+    if (objectBuffer)
+    {
+        GLuint buffers[] = { objectBuffer, visibilityBuffer, phaseBuffers[0], phaseBuffers[1], statsBuffer };
+        glDeleteBuffers(5, buffers);
+    }
+    objectBuffer = visibilityBuffer = phaseBuffers[0] = phaseBuffers[1] = statsBuffer = 0;
+    sourceBuffer = 0;
+    objectCount = commandCount = 0;
+}
+
+
+bool OcclusionCuller::CreatePyramid(int width, int height)
+{
+    DestroyPyramid();
+    if (width <= 0 || height <= 0)
+        return false;
+
+    depthWidth = width;
+    depthHeight = height;
+    glGenTextures(1, &depthTexture);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, depthWidth, depthHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+    // Level 0 is the power of two below the screen on each axis, so every
+    // level above it halves exactly
+    pyramidWidth = previousPowerOfTwo(width);
+    pyramidHeight = previousPowerOfTwo(height);
+    pyramidLevels = 1;
+    while ((pyramidWidth >> pyramidLevels) > 0 || (pyramidHeight >> pyramidLevels) > 0)
+        ++pyramidLevels;
+    glGenTextures(1, &pyramid);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, pyramid);
+    glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    cout << "INFO: Occlusion culling: " << pyramidWidth << "x" << pyramidHeight << " depth pyramid, "
+         << pyramidLevels << " levels" << endl;
+    return true;
+}
+
+
+void OcclusionCuller::DestroyPyramid()
+{
+    if (depthTexture)
+    {
+        URenderState().ForgetTexture(depthTexture);
+        glDeleteTextures(1, &depthTexture);
+    }
+    if (pyramid)
+    {
+        URenderState().ForgetTexture(pyramid);
+        glDeleteTextures(1, &pyramid);
+    }
+    depthTexture = pyramid = 0;
+    depthWidth = depthHeight = pyramidWidth = pyramidHeight = pyramidLevels = 0;
+}
+
+
+void OcclusionCuller::SetBox(size_t object, const Aabb& box)
+{
+    if (object >= objectCount)
+        return;
+    glm::vec4 bounds[2] = { glm::vec4(box.min, 1.0f), glm::vec4(box.max, 1.0f) };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, object * sizeof(bounds), sizeof(bounds), bounds);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+GLuint OcclusionCuller::Cull(const ShaderProgram& cullProgram, int phase)
+{
+    GLuint commands = phaseBuffers[phase == 1 ? 0 : 1];
+    if (!objectBuffer || !cullProgram.Id())
+        return sourceBuffer;
+
+    cullProgram.Use();
+    cullProgram.Set(cullProgram.Uniform(UNIFORM_PHASE), phase);
+    cullProgram.Set(cullProgram.Uniform(UNIFORM_OBJECT_COUNT), (int)objectCount);
+    cullProgram.Set(cullProgram.Uniform(UNIFORM_COMMAND_COUNT), (int)commandCount);
+    if (phase != 1 && pyramid)
+    {
+        URenderState().BindTexture(OCCLUSION_TEXTURE_UNIT, GL_TEXTURE_2D, pyramid);
+        cullProgram.Set(cullProgram.Uniform(UNIFORM_PYRAMID), OCCLUSION_TEXTURE_UNIT);
+        cullProgram.Set(cullProgram.Uniform(UNIFORM_PYRAMID_SIZE), glm::vec2((float)pyramidWidth, (float)pyramidHeight));
+        cullProgram.Set(cullProgram.Uniform(UNIFORM_PYRAMID_LEVELS), pyramidLevels);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_OBJECT_BINDING, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_VISIBILITY_BINDING, visibilityBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_SOURCE_BINDING, sourceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_COMMAND_BINDING, commands);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OCCLUSION_STATS_BINDING, statsBuffer);
+    glDispatchCompute(groups((int)objectCount, CULL_GROUP_SIZE), 1, 1);
+
+    // The commands are read by the draws that follow, the visibility by the
+    // next phase and, after phase 2, by the render queue's buffer copies
+    GLbitfield barriers = GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT;
+    if (phase != 1)
+    {
+        barriers |= GL_BUFFER_UPDATE_BARRIER_BIT;
+        ++frames;
+    }
+    glMemoryBarrier(barriers);
+    return commands;
+}
+
+
+void OcclusionCuller::BuildPyramid(const ShaderProgram& hizProgram, int width, int height)
+{
+    if (!hizProgram.Id())
+        return;
+    if ((width != depthWidth || height != depthHeight) && !CreatePyramid(width, height))
+        return;
+
+    // Depth of the draws so far, from the default framebuffer
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, depthWidth, depthHeight);
+
+    hizProgram.Use();
+    ShaderProgram::Handle sourceLevel = hizProgram.Uniform(UNIFORM_SOURCE_LEVEL);
+    hizProgram.Set(hizProgram.Uniform(UNIFORM_SOURCE), OCCLUSION_TEXTURE_UNIT);
+    for (int level = 0; level < pyramidLevels; ++level)
+    {
+        // Level 0 reduces the depth copy, every later level the one before it
+        URenderState().BindTexture(OCCLUSION_TEXTURE_UNIT, GL_TEXTURE_2D, level == 0 ? depthTexture : pyramid);
+        hizProgram.Set(sourceLevel, level == 0 ? 0 : level - 1);
+        glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute(groups(max(pyramidWidth >> level, 1), PYRAMID_GROUP_SIZE),
+                          groups(max(pyramidHeight >> level, 1), PYRAMID_GROUP_SIZE), 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+}
+
+
+void OcclusionCuller::PrintStats() const
+{
+    cout << "INFO: Occlusion culling: " << objectCount << " objects, ";
+    if (!frames || !statsBuffer)
+    {
+        cout << "never culled" << endl;
+        return;
+    }
+
+    // One read at exit, the counters stay on the GPU while running
+    GLuint stats[STAT_COUNT] = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    double tested = stats[0] ? (double)stats[0] : 1.0;
+    cout << frames << " frames, " << 100.0 * stats[1] / tested << "% outside the frustum, "
+         << 100.0 * stats[2] / tested << "% occluded, " << (double)stats[3] / frames << " draws in phase 1 and "
+         << (double)stats[4] / frames << " in phase 2 per frame" << endl;
+}
@@ -0,0 +1,83 @@
+// Occlusion.h
+// Two phase occlusion culling on the GPU against a hierarchical depth
+// buffer. The static pool's draws and the queue's planets are scene objects
+// with a world space box each. Every frame:
+//
+//   phase 1  draws the pool's draws that were visible last frame,
+//   pyramid  copies the depth buffer and reduces it into a mip chain whose
+//            texels hold the farthest depth they cover (hiz.comp),
+//   phase 2  tests every box against the pyramid, draws the pool's draws
+//            that are visible now but were skipped by phase 1, and stores
+//            each object's visibility for the next frame.
+//
+// Both phases run occlusion_cull.comp, which writes a copy of the pool's
+// indirect commands with instanceCount zeroed for culled draws; the pool
+// draws straight from that copy. Objects past the pool's draws (the planets)
+// are drawn after phase 2 through the render queue, gated by their word of
+// VisibilityBuffer(). Nothing is read back by the CPU.
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <vector>
+
+#include "Culling.h"
+#include "ShaderProgram.h"
+
+// Shader storage binding points of occlusion_cull.comp
+const GLuint OCCLUSION_OBJECT_BINDING = 3;
+const GLuint OCCLUSION_VISIBILITY_BINDING = 4;
+const GLuint OCCLUSION_SOURCE_BINDING = 5;
+const GLuint OCCLUSION_COMMAND_BINDING = 6;
+const GLuint OCCLUSION_STATS_BINDING = 7;
+// Texture unit the compute programs sample through
+const int OCCLUSION_TEXTURE_UNIT = 3;
+
+class OcclusionCuller
+{
+public:
+    OcclusionCuller() {}
+    ~OcclusionCuller() { Destroy(); }
+
+    // One object per box. The first commandCount objects are the draws of
+    // the indirect commands in commandBuffer (5 GLuints each), in order.
+    bool Create(const std::vector<Aabb>& boxes, GLuint commandBuffer, size_t commandCount);
+    void Destroy();
+
+    // New box of an object that moved
+    void SetBox(size_t object, const Aabb& box);
+
+    // Writes the commands of phase 1 or 2 and returns the buffer to draw them from
+    GLuint Cull(const ShaderProgram& cullProgram, int phase);
+    // Builds the depth pyramid from the default framebuffer's depth, between the phases
+    void BuildPyramid(const ShaderProgram& hizProgram, int width, int height);
+
+    // One GLuint per object, 1 while the object is visible
+    GLuint VisibilityBuffer() const { return visibilityBuffer; }
+    void PrintStats() const;
+
+private:
+    GLuint objectBuffer = 0;
+    GLuint visibilityBuffer = 0;
+    GLuint sourceBuffer = 0;            // not owned
+    GLuint phaseBuffers[2] = {};
+    GLuint statsBuffer = 0;
+    size_t objectCount = 0;
+    size_t commandCount = 0;
+
+    GLuint depthTexture = 0;            // copy of the depth buffer
+    GLuint pyramid = 0;
+    int depthWidth = 0, depthHeight = 0;
+    int pyramidWidth = 0, pyramidHeight = 0;
+    int pyramidLevels = 0;
+
+    bool CreatePyramid(int width, int height);
+    void DestroyPyramid();
+
+    // stats
+    unsigned long long frames = 0;
+};
+
+#endif
@@ -0,0 +1,53 @@
+// Parallel.h
+// Small helpers for splitting CPU work across the hardware threads
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use for CPU side jobs (at least 1)
+inline unsigned UWorkerCount()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+// Calls func(begin, end) for contiguous slices of [0, count) on worker threads.
+// Ranges smaller than minPerThread items per thread run on the calling thread.
+template <typename Func>
+void UParallelFor(size_t count, size_t minPerThread, Func func)
+{
+    if (count == 0)
+        return;
+
+    size_t threads = std::min<size_t>(UWorkerCount(), (count + minPerThread - 1) / std::max<size_t>(minPerThread, 1));
+    if (threads <= 1)
+    {
+        func(size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    size_t slice = (count + threads - 1) / threads;
+    for (size_t t = 1; t < threads; ++t)
+    {
+        size_t begin = t * slice;
+        size_t end = std::min(count, begin + slice);
+        if (begin >= end)
+            break;
+        workers.emplace_back(func, begin, end);
+    }
+
+    // The calling thread takes the first slice
+    func(size_t(0), std::min(count, slice));
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+#endif
@@ -0,0 +1,102 @@
+// Profile.cpp
+// CPU frame profile, see Profile.h
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>         // cout, cerr
+
+#include "Profile.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    double elapsedMs(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+    {
+        return chrono::duration<double, milli>(end - start).count();
+    }
+}
+
+
+void FrameProfile::BeginFrame()
+{
+    frameStart = Clock::now();
+    if (!started)
+    {
+        reportStart = frameStart;
+        started = true;
+    }
+    for (Section& section : sections)
+        section.frame = 0.0;
+}
+
+
+void FrameProfile::EndFrame()
+{
+    Clock::time_point now = Clock::now();
+    double frame = elapsedMs(frameStart, now);
+    frameTotal += frame;
+    frameWorst = std::max(frameWorst, frame);
+    ++frames;
+
+    for (Section& section : sections)
+    {
+        section.total += section.frame;
+        section.worst = std::max(section.worst, section.frame);
+    }
+
+    if (elapsedMs(reportStart, now) >= reportSeconds * 1000.0)
+    {
+        Report();
+        reportStart = now;
+    }
+}
+
+
+void FrameProfile::BeginSection(const char* name)
+{
+    currentSection = -1;
+    for (size_t i = 0; i < sections.size(); ++i)
+    {
+        if (sections[i].name == name)
+            currentSection = (int)i;
+    }
+    if (currentSection < 0)
+    {
+        Section section;
+        section.name = name;
+        currentSection = (int)sections.size();
+        sections.push_back(section);
+    }
+    sectionStart = Clock::now();
+}
+
+
+void FrameProfile::EndSection()
+{
+    if (currentSection < 0)
+        return;
+    sections[currentSection].frame += elapsedMs(sectionStart, Clock::now());
+    currentSection = -1;
+}
+
+
+void FrameProfile::Report()
+{
+    if (frames == 0)
+        return;
+
+    cout << fixed << setprecision(3)
+         << "INFO: CPU frame " << frameTotal / frames << " ms avg, " << frameWorst << " ms worst over " << frames << " frames" << endl;
+    for (Section& section : sections)
+    {
+        cout << "INFO:   " << section.name << " " << section.total / frames << " ms avg, " << section.worst << " ms worst" << endl;
+        section.total = 0.0;
+        section.worst = 0.0;
+    }
+    cout << defaultfloat;
+
+    frameTotal = 0.0;
+    frameWorst = 0.0;
+    frames = 0;
+}
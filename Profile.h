@@ -0,0 +1,64 @@
+// Profile.h
+// CPU side frame profile. Named sections are timed every frame and their
+// average and worst times are printed at a fixed interval, which is enough
+// to see where the render loop spends its submission time.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <chrono>
+#include <vector>
+
+class FrameProfile
+{
+public:
+    explicit FrameProfile(double reportSeconds = 5.0) : reportSeconds(reportSeconds) {}
+
+    void BeginFrame();
+    // Accumulates the frame and prints the report once reportSeconds have passed
+    void EndFrame();
+
+    // Sections may not nest; names must be string literals (compared by address)
+    void BeginSection(const char* name);
+    void EndSection();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Section
+    {
+        const char* name;
+        double total = 0.0;             // ms since the last report
+        double worst = 0.0;
+        double frame = 0.0;             // ms in the current frame
+    };
+
+    void Report();
+
+    double reportSeconds;
+    std::vector<Section> sections;
+    int currentSection = -1;
+    Clock::time_point sectionStart;
+    Clock::time_point frameStart;
+    Clock::time_point reportStart;
+    bool started = false;
+    double frameTotal = 0.0;
+    double frameWorst = 0.0;
+    int frames = 0;
+};
+
+// Times the enclosing scope as one section
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfile& profile, const char* name) : profile(profile) { profile.BeginSection(name); }
+    ~ProfileScope() { profile.EndSection(); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    FrameProfile& profile;
+};
+
+#endif
@@ -0,0 +1,239 @@
+// ProgramCache.cpp
+// Program binary cache, see ProgramCache.h
+
+#include <chrono>
+#include <fstream>
+#include <iostream>         // cout, cerr
+
+#include "Hash.h"
+#include "ProgramCache.h"
+#include "ShaderProgram.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const unsigned PROGRAM_CACHE_MAGIC = 0x43475250;   // "PRGC"
+    const unsigned PROGRAM_CACHE_VERSION = 1;
+
+    // Larger entries mean a corrupt file
+    const unsigned MAX_BINARY_SIZE = 64 * 1024 * 1024;
+
+    template <typename T>
+    void writeValue(ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool readValue(ifstream& in, T& value)
+    {
+        return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    unsigned long long hashGlString(GLenum name, unsigned long long hash)
+    {
+        const GLubyte* text = glGetString(name);
+        return text ? UHashString(reinterpret_cast<const char*>(text), hash) : hash;
+    }
+}
+
+
+ProgramCache& UProgramCache()
+{
+    static ProgramCache cache;
+    return cache;
+}
+
+
+void ProgramCache::Open(const char* name)
+{
+    filename = name;
+    entries.clear();
+    dirty = false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    enabled = formats > 0;
+    if (!enabled)
+    {
+        cout << "INFO: Driver has no program binary formats, shaders are compiled every start" << endl;
+        return;
+    }
+
+    // A driver update can change what a binary means even for the same sources
+    driverHash = hashGlString(GL_VENDOR, HASH_SEED);
+    driverHash = hashGlString(GL_RENDERER, driverHash);
+    driverHash = hashGlString(GL_VERSION, driverHash);
+    driverHash = hashGlString(GL_SHADING_LANGUAGE_VERSION, driverHash);
+
+    ifstream in(filename, ios::binary);
+    if (!in)
+        return;
+
+    unsigned magic, version, count;
+    unsigned long long fileDriverHash;
+    if (!readValue(in, magic) || !readValue(in, version) || magic != PROGRAM_CACHE_MAGIC || version != PROGRAM_CACHE_VERSION)
+        return;
+    if (!readValue(in, fileDriverHash) || !readValue(in, count))
+        return;
+    if (fileDriverHash != driverHash)
+    {
+        cout << "INFO: Program cache was built by another driver, recompiling shaders" << endl;
+        dirty = true;
+        return;
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        unsigned long long key;
+        unsigned size;
+        Entry entry;
+        if (!readValue(in, key) || !readValue(in, entry.format) || !readValue(in, size) || size == 0 || size > MAX_BINARY_SIZE)
+            break;
+        entry.binary.resize(size);
+        if (!in.read(reinterpret_cast<char*>(entry.binary.data()), size))
+            break;
+        entries[key] = std::move(entry);
+    }
+}
+
+
+bool ProgramCache::Save()
+{
+    unsigned used = 0;
+    for (const auto& entry : entries)
+        used += entry.second.used ? 1 : 0;
+    if (!enabled || (!dirty && used == entries.size()))
+        return true;
+
+    ofstream out(filename, ios::binary);
+    if (!out)
+        return false;
+
+    writeValue(out, PROGRAM_CACHE_MAGIC);
+    writeValue(out, PROGRAM_CACHE_VERSION);
+    writeValue(out, driverHash);
+    writeValue(out, used);
+    for (const auto& entry : entries)
+    {
+        if (!entry.second.used)
+            continue;
+        writeValue(out, entry.first);
+        writeValue(out, entry.second.format);
+        writeValue(out, (unsigned)entry.second.binary.size());
+        out.write(reinterpret_cast<const char*>(entry.second.binary.data()), entry.second.binary.size());
+    }
+
+    dirty = !out;
+    return bool(out);
+}
+
+
+bool ProgramCache::CreateProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+{
+    programId = BeginProgram(vtxShaderSource, fragShaderSource);
+    return FinishProgram(vtxShaderSource, fragShaderSource, programId);
+}
+
+
+unsigned long long ProgramCache::Key(const char* vtxShaderSource, const char* fragShaderSource) const
+{
+    unsigned long long key = UHashString(vtxShaderSource);
+    key = UHashString(fragShaderSource, key);
+    return UHashBytes(&driverHash, sizeof(driverHash), key);
+}
+
+
+GLuint ProgramCache::BeginProgram(const char* vtxShaderSource, const char* fragShaderSource)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    GLuint programId;
+    auto cached = enabled ? entries.find(Key(vtxShaderSource, fragShaderSource)) : entries.end();
+    if (cached != entries.end())
+    {
+        programId = glCreateProgram();
+        glProgramBinary(programId, cached->second.format, cached->second.binary.data(), (GLsizei)cached->second.binary.size());
+    }
+    else
+        programId = USubmitShaderProgram(vtxShaderSource, fragShaderSource);
+    pending[programId] = cached != entries.end();
+
+    seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return programId;
+}
+
+
+bool ProgramCache::FinishProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    unsigned long long key = Key(vtxShaderSource, fragShaderSource);
+    bool fromBinary = pending[programId];
+    pending.erase(programId);
+
+    bool created;
+    if (fromBinary)
+    {
+        GLint success = 0;
+        glGetProgramiv(programId, GL_LINK_STATUS, &success);
+        created = success != 0;
+        if (created)
+        {
+            ++hits;
+            auto cached = entries.find(key);
+            if (cached != entries.end())
+                cached->second.used = true;
+        }
+        else
+        {
+            // Stale or corrupt, compile and replace it
+            ++rejected;
+            entries.erase(key);
+            dirty = true;
+            glDeleteProgram(programId);
+            programId = USubmitShaderProgram(vtxShaderSource, fragShaderSource);
+        }
+    }
+    if (!fromBinary || !created)
+    {
+        ++misses;
+        created = UFinishShaderProgram(programId);
+        if (created && enabled)
+            StoreBinary(key, programId);
+    }
+
+    seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return created;
+}
+
+
+void ProgramCache::StoreBinary(unsigned long long key, GLuint programId)
+{
+    GLint length = 0;
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    Entry entry;
+    entry.binary.resize(length);
+    GLsizei written = 0;
+    glGetProgramBinary(programId, length, &written, &entry.format, entry.binary.data());
+    if (written <= 0)
+        return;
+
+    entry.binary.resize(written);
+    entry.used = true;
+    entries[key] = std::move(entry);
+    dirty = true;
+}
+
+
+void ProgramCache::PrintStats() const
+{
+    cout << "INFO: Program cache: " << hits << " loaded, " << misses << " compiled";
+    if (rejected)
+        cout << " (" << rejected << " cached binaries rejected)";
+    cout << ", " << seconds * 1000.0 << " ms creating programs" << endl;
+}
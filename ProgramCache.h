@@ -0,0 +1,71 @@
+// ProgramCache.h
+// On-disk cache of linked program binaries. Programs are keyed by a hash of
+// their shader sources and of the driver's vendor, renderer and version
+// strings; a cached binary is loaded with glProgramBinary, and anything the
+// driver rejects (or has never seen) is compiled from source and added to
+// the cache for the next start.
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cache file in the working directory, next to the textures' .mips files
+const char* const PROGRAM_CACHE_FILE = "shaders.cache";
+
+class ProgramCache
+{
+public:
+    // Reads the cache file. Entries from another driver are dropped. Needs a
+    // current context; without program binary support the cache stays off
+    // and every program is compiled.
+    void Open(const char* filename = PROGRAM_CACHE_FILE);
+    // Writes back the programs this run loaded or added, dropping the ones it
+    // never asked for (older versions of edited shaders)
+    bool Save();
+
+    // Links a program from its cached binary, or compiles it and caches the result
+    bool CreateProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+
+    // CreateProgram in two halves, so several programs can be in the driver's
+    // hands at once. BeginProgram hands over the cached binary or the sources
+    // without waiting; FinishProgram waits for the result, falls back to
+    // compiling if the binary was refused, and caches new binaries.
+    GLuint BeginProgram(const char* vtxShaderSource, const char* fragShaderSource);
+    bool FinishProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+
+    void PrintStats() const;
+
+private:
+    struct Entry
+    {
+        GLenum format;
+        std::vector<unsigned char> binary;
+        bool used = false;      // loaded or stored by this run
+    };
+
+    unsigned long long Key(const char* vtxShaderSource, const char* fragShaderSource) const;
+    void StoreBinary(unsigned long long key, GLuint programId);
+
+    std::string filename;
+    bool enabled = false;
+    bool dirty = false;
+    unsigned long long driverHash = 0;
+    std::unordered_map<unsigned long long, Entry> entries;
+    std::unordered_map<GLuint, bool> pending;   // begun programs, true when loaded from a binary
+
+    // stats
+    unsigned hits = 0;
+    unsigned misses = 0;
+    unsigned rejected = 0;      // cached binaries the driver refused
+    double seconds = 0.0;       // spent in Begin/FinishProgram
+};
+
+// Cache shared by every ShaderProgram
+ProgramCache& UProgramCache();
+
+#endif
@@ -0,0 +1,255 @@
+// RenderQueue.cpp
+// Sorted draw submission, see RenderQueue.h
+
+#include <algorithm>
+#include <cstddef>          // offsetof
+#include <iostream>         // cout, cerr
+
+#include "RenderQueue.h"
+#include "RenderState.h"
+#include "VertexLayout.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Per-instance index into the frame's model matrices, selected by baseInstance
+    typedef VertexLayout<VertexAttribute<RENDER_QUEUE_DRAW_INDEX_LOCATION, GLuint, 1>> DrawIndexLayout;
+
+    const int DEPTH_BITS = 24;
+    const int VERTEX_ARRAY_BITS = 14;
+    const int LAYER_BITS = 12;
+    const int PROGRAM_BITS = 10;
+
+    const int DEPTH_SHIFT = 0;
+    const int VERTEX_ARRAY_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+    const int LAYER_SHIFT = VERTEX_ARRAY_SHIFT + VERTEX_ARRAY_BITS;
+    const int PROGRAM_SHIFT = LAYER_SHIFT + LAYER_BITS;
+    const int PASS_SHIFT = PROGRAM_SHIFT + PROGRAM_BITS;
+
+    // Matches DrawElementsIndirectCommand
+    struct IndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    uint64_t field(uint64_t value, int bits, int shift)
+    {
+        return (value & ((uint64_t(1) << bits) - 1)) << shift;
+    }
+}
+
+
+void URadixSort(vector<SortEntry>& entries, vector<SortEntry>& scratch)
+{
+    scratch.resize(entries.size());
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t counts[256] = {};
+        for (const SortEntry& entry : entries)
+            ++counts[(entry.key >> shift) & 0xFF];
+
+        // Every key shares this digit, the pass would not move anything
+        if (counts[(entries.empty() ? 0 : entries[0].key >> shift) & 0xFF] == entries.size())
+            continue;
+
+        size_t offset = 0;
+        for (size_t& count : counts)
+        {
+            size_t start = offset;
+            offset += count;
+            count = start;
+        }
+        for (const SortEntry& entry : entries)
+            scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+        entries.swap(scratch);
+    }
+}
+
+
+bool RenderQueue::Create(size_t draws)
+{
+    Destroy();
+
+    if (!drawData.Create(draws * sizeof(glm::mat4)))
+        return false;
+    maxDraws = draws;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+    vector<GLuint> drawIndices(maxDraws);
+    for (size_t i = 0; i < maxDraws; ++i)
+        drawIndices[i] = (GLuint)i;
+    glGenBuffers(1, &drawIndexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLuint), drawIndices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+
+void RenderQueue::Destroy()
+{
+    drawData.Destroy();
+    if (drawIndexBuffer)
+        glDeleteBuffers(1, &drawIndexBuffer);
+    drawIndexBuffer = 0;
+    maxDraws = 0;
+}
+
+
+void RenderQueue::AttachVertexArray(GLuint vertexArray) const
+{
+    URenderState().BindVertexArray(vertexArray);
+    DrawIndexLayout::Apply(DRAW_INDEX_BUFFER_BINDING, 1);
+    DrawIndexLayout::Bind(DRAW_INDEX_BUFFER_BINDING, drawIndexBuffer);
+}
+
+
+void RenderQueue::Begin(const glm::vec3& camera, float far)
+{
+    cameraPosition = camera;
+    farPlane = far;
+    items.clear();
+}
+
+
+void RenderQueue::Submit(const DrawItem& item)
+{
+    items.push_back(item);
+}
+
+
+uint64_t RenderQueue::MakeKey(const DrawItem& item) const
+{
+    // Distance of the model's origin, quantized over [0, farPlane]
+    glm::vec3 origin(item.model[3]);
+    float distance = glm::clamp(glm::distance(origin, cameraPosition) / farPlane, 0.0f, 1.0f);
+    uint64_t depth = uint64_t(distance * ((1 << DEPTH_BITS) - 1));
+    if (item.pass == RENDER_PASS_TRANSPARENT)
+        depth = ((1 << DEPTH_BITS) - 1) - depth;
+
+    return field(item.pass, 4, PASS_SHIFT) |
+           field(item.program ? item.program->Id() : 0, PROGRAM_BITS, PROGRAM_SHIFT) |
+           field(uint64_t(item.layer + 1), LAYER_BITS, LAYER_SHIFT) |
+           field(item.vertexArray, VERTEX_ARRAY_BITS, VERTEX_ARRAY_SHIFT) |
+           field(depth, DEPTH_BITS, DEPTH_SHIFT);
+}
+
+
+void RenderQueue::Execute()
+{
+    keys.resize(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        keys[i].key = MakeKey(items[i]);
+        keys[i].index = (uint32_t)i;
+    }
+    URadixSort(keys, scratch);
+
+    // Every model matrix of the batch in one write, in the order the draws run
+    GLintptr offset = 0;
+    size_t size = keys.size() * sizeof(glm::mat4);
+    glm::mat4* models = keys.empty() ? nullptr : static_cast<glm::mat4*>(drawData.Allocate(size, storageAlignment, offset));
+    if (!models)
+    {
+        if (!keys.empty())
+            cout << "Render queue: no room for " << keys.size() << " draws this frame" << endl;
+        return;
+    }
+    for (size_t i = 0; i < keys.size(); ++i)
+        models[i] = items[keys[i].index].model;
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, RENDER_QUEUE_DRAW_BINDING, drawData.Id(), offset, size);
+
+    programChanges = layerChanges = vertexArrayChanges = 0;
+    meshletDraws = meshletRanges = gatedDraws = 0;
+    const ShaderProgram* program = nullptr;
+    int layer = -1;
+    GLuint vertexArray = 0;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        const DrawItem& item = items[keys[i].index];
+        // Every meshlet faces away
+        if (item.indexed && item.meshlets && item.meshlets->Visible().empty())
+            continue;
+        if (item.program != program)
+        {
+            item.program->Use();
+            program = item.program;
+            layer = -1;             // layer uniforms belong to the program
+            ++programChanges;
+        }
+        if (item.textures && item.layer != layer)
+        {
+            item.textures->BindLayer(*program, item.layer);
+            layer = item.layer;
+            ++layerChanges;
+        }
+        if (item.vertexArray != vertexArray)
+        {
+            URenderState().BindVertexArray(item.vertexArray);
+            vertexArray = item.vertexArray;
+            ++vertexArrayChanges;
+        }
+
+        // baseInstance selects models[i] through the draw index attribute
+        if (item.indexed && (item.meshlets || item.visibility) && DrawIndirect(item, (GLuint)i))
+            continue;
+        if (item.indexed)
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, item.count, GL_UNSIGNED_INT,
+                                                          (void*)(sizeof(GLuint) * item.firstIndex), 1, item.baseVertex, (GLuint)i);
+        else
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLES, item.baseVertex, item.count, 1, (GLuint)i);
+    }
+}
+
+
+bool RenderQueue::DrawIndirect(const DrawItem& item, GLuint drawIndex)
+{
+    MeshletRange whole = { 0, (GLuint)item.count };
+    const MeshletRange* ranges = item.meshlets ? item.meshlets->Visible().data() : &whole;
+    size_t rangeCount = item.meshlets ? item.meshlets->Visible().size() : 1;
+    GLintptr offset = 0;
+    IndirectCommand* commands = static_cast<IndirectCommand*>(drawData.Allocate(rangeCount * sizeof(IndirectCommand), sizeof(GLuint), offset));
+    if (!commands)
+        return false;       // drawn whole instead
+
+    for (size_t r = 0; r < rangeCount; ++r)
+        commands[r] = IndirectCommand{ ranges[r].indexCount, 1, item.firstIndex + ranges[r].firstIndex, item.baseVertex, drawIndex };
+
+    // The GPU's flag replaces each instance count, written before the draw reads it
+    if (item.visibility)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, item.visibility);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, drawData.Id());
+        for (size_t r = 0; r < rangeCount; ++r)
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, item.visibilityIndex * sizeof(GLuint),
+                                offset + r * sizeof(IndirectCommand) + offsetof(IndirectCommand, instanceCount), sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        ++gatedDraws;
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawData.Id());
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, (GLsizei)rangeCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    if (item.meshlets)
+    {
+        ++meshletDraws;
+        meshletRanges += (unsigned)rangeCount;
+    }
+    return true;
+}
+
+
+void RenderQueue::PrintStats() const
+{
+    cout << "INFO: Render queue: " << items.size() << " draws, " << programChanges << " program changes, "
+         << layerChanges << " layer changes, " << vertexArrayChanges << " vertex array changes, "
+         << meshletDraws << " meshlet draws in " << meshletRanges << " ranges, "
+         << gatedDraws << " draws gated by GPU visibility" << endl;
+    drawData.PrintStats();
+}
@@ -0,0 +1,134 @@
+// RenderQueue.h
+// Per-frame list of draws. Each draw gets a 64 bit sort key built from its
+// pass, program, texture layer, vertex array and depth; the keys are radix
+// sorted before execution so draws that share state run back to back and
+// opaque geometry is drawn front to back.
+//
+// Model matrices are not set as uniforms. Execute writes the frame's
+// matrices, in draw order, into a persistently mapped ring buffer bound as a
+// shader storage buffer, and each draw selects its matrix through an
+// instanced draw index attribute offset by the draw's baseInstance. GLSL side:
+//
+//   layout(location = 3) in uint drawIndex;
+//   layout(std430, binding = 2) readonly buffer QueueDraws { mat4 models[]; };
+//
+// Draws of meshes split into meshlets (Meshlet.h) draw only the ranges their
+// last MeshletMesh::Cull kept, with one glMultiDrawElementsIndirect whose
+// commands go into the same ring buffer. Draws gated by a GPU visibility
+// flag (Occlusion.h) are drawn the same way, the flag copied into each
+// command's instanceCount with glCopyBufferSubData, so the CPU never waits
+// for the result.
+//
+// Key layout, most significant first:
+//   pass 4 | program 10 | layer 12 | vertex array 14 | depth 24
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Meshlet.h"
+#include "RingBuffer.h"
+#include "ShaderProgram.h"
+#include "TextureArray.h"
+
+// Shader storage binding point of the model matrices
+const GLuint RENDER_QUEUE_DRAW_BINDING = 2;
+// Vertex attribute carrying the draw index (uint, one per instance)
+const GLuint RENDER_QUEUE_DRAW_INDEX_LOCATION = 3;
+// Draws a frame can hold, over every Execute of the frame
+const size_t RENDER_QUEUE_MAX_DRAWS = 4096;
+
+enum RenderPass
+{
+    RENDER_PASS_OPAQUE,         // front to back
+    RENDER_PASS_TRANSPARENT     // back to front, after every opaque draw
+};
+
+struct DrawItem
+{
+    RenderPass pass = RENDER_PASS_OPAQUE;
+    const ShaderProgram* program = nullptr;
+    glm::mat4 model;
+    GLuint vertexArray = 0;                 // set up with RenderQueue::AttachVertexArray
+    GLsizei count = 0;                      // vertices, or indices when indexed
+    bool indexed = false;                   // GL_UNSIGNED_INT elements from the VAO's element buffer
+    GLint baseVertex = 0;                   // first vertex, for meshes sharing buffers (MeshHeap)
+    GLuint firstIndex = 0;                  // first element when indexed
+    const MeshletMesh* meshlets = nullptr;  // indexed only: draws its visible ranges, relative to firstIndex
+    GLuint visibility = 0;                  // indexed only: buffer of GLuint flags, the draw is skipped when
+    GLuint visibilityIndex = 0;             // the flag at visibilityIndex is 0 at execution (0 draws always)
+    const TextureArray* textures = nullptr; // layer source, nullptr for programs without one
+    int layer = -1;
+};
+
+// LSD radix sort of 64 bit keys carrying a 32 bit payload, 8 bits per pass.
+// Passes where every key has the same digit are skipped.
+struct SortEntry
+{
+    uint64_t key;
+    uint32_t index;
+};
+void URadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+class RenderQueue
+{
+public:
+    RenderQueue() {}
+    ~RenderQueue() { Destroy(); }
+
+    bool Create(size_t maxDraws = RENDER_QUEUE_MAX_DRAWS);
+    void Destroy();
+
+    // Adds the draw index attribute to a vertex array drawn through the queue,
+    // on DRAW_INDEX_BUFFER_BINDING (the vertices must not use that binding)
+    void AttachVertexArray(GLuint vertexArray) const;
+
+    // Bracket everything a frame draws through the queue. BeginFrame may wait
+    // for the GPU to release the frame's part of the ring buffer.
+    void BeginFrame() { drawData.BeginFrame(); }
+    void EndFrame() { drawData.EndFrame(); }
+
+    // Starts a batch; depth is measured from the camera and scaled by farPlane
+    void Begin(const glm::vec3& cameraPosition, float farPlane);
+    void Submit(const DrawItem& item);
+    // Sorts and draws everything submitted since Begin. A frame can execute
+    // several batches, each gets its own part of the ring buffer.
+    void Execute();
+
+    size_t DrawCount() const { return items.size(); }
+    void PrintStats() const;
+
+private:
+    RingBuffer drawData;
+    GLuint drawIndexBuffer = 0;     // 0, 1, 2, ... read through baseInstance
+    size_t maxDraws = 0;
+    GLint storageAlignment = 1;
+
+    uint64_t MakeKey(const DrawItem& item) const;
+    // Writes the item's visible meshlet ranges, or its whole range, as
+    // indirect commands gated by its visibility flag and draws them; false
+    // when the ring buffer has no room left
+    bool DrawIndirect(const DrawItem& item, GLuint drawIndex);
+
+    glm::vec3 cameraPosition;
+    float farPlane = 1.0f;
+    std::vector<DrawItem> items;
+    std::vector<SortEntry> keys;
+    std::vector<SortEntry> scratch;
+
+    // stats of the last Execute
+    unsigned programChanges = 0;
+    unsigned layerChanges = 0;
+    unsigned vertexArrayChanges = 0;
+    unsigned meshletDraws = 0;
+    unsigned meshletRanges = 0;
+    unsigned gatedDraws = 0;
+};
+
+#endif
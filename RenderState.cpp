@@ -0,0 +1,180 @@
+// RenderState.cpp
+// Redundant GL state call elimination, see RenderState.h
+
+#include <iostream>         // cout, cerr
+
+#include "RenderState.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Never a valid GL name, marks bindings the cache does not know
+    const GLuint UNKNOWN_NAME = ~0u;
+}
+
+
+RenderState& URenderState()
+{
+    static RenderState state;
+    return state;
+}
+
+
+int RenderState::TargetIndex(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_2D_ARRAY: return 1;
+    case GL_TEXTURE_3D: return 2;
+    case GL_TEXTURE_CUBE_MAP: return 3;
+    default: return -1;
+    }
+}
+
+
+int RenderState::CapabilityIndex(GLenum capability)
+{
+    switch (capability)
+    {
+    case GL_DEPTH_TEST: return 0;
+    case GL_CULL_FACE: return 1;
+    case GL_BLEND: return 2;
+    case GL_SCISSOR_TEST: return 3;
+    case GL_STENCIL_TEST: return 4;
+    case GL_POLYGON_OFFSET_FILL: return 5;
+    default: return -1;
+    }
+}
+
+
+bool RenderState::Elide(bool unchanged)
+{
+    if (unchanged)
+        ++elided;
+    else
+        ++issued;
+    return unchanged;
+}
+
+
+void RenderState::UseProgram(GLuint newProgram)
+{
+    if (Elide(program == newProgram))
+        return;
+    glUseProgram(newProgram);
+    program = newProgram;
+}
+
+
+void RenderState::BindVertexArray(GLuint newVertexArray)
+{
+    if (Elide(vertexArray == newVertexArray))
+        return;
+    glBindVertexArray(newVertexArray);
+    vertexArray = newVertexArray;
+}
+
+
+void RenderState::BindTexture(int unit, GLenum target, GLuint texture)
+{
+    int index = TargetIndex(target);
+    if (index >= 0 && unit < RENDER_STATE_TEXTURE_UNITS && Elide(textures[unit][index] == texture))
+        return;
+
+    if (activeUnit != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        ++issued;
+    }
+    glBindTexture(target, texture);
+
+    if (index >= 0 && unit < RENDER_STATE_TEXTURE_UNITS)
+        textures[unit][index] = texture;
+    else
+        ++issued;
+}
+
+
+void RenderState::SetCapability(GLenum capability, bool enabled)
+{
+    int index = CapabilityIndex(capability);
+    if (index >= 0 && Elide(capabilities[index] == (enabled ? 1 : 0)))
+        return;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+
+    if (index >= 0)
+        capabilities[index] = enabled ? 1 : 0;
+    else
+        ++issued;
+}
+
+
+void RenderState::Enable(GLenum capability)
+{
+    SetCapability(capability, true);
+}
+
+
+void RenderState::Disable(GLenum capability)
+{
+    SetCapability(capability, false);
+}
+
+
+void RenderState::ForgetProgram(GLuint deleted)
+{
+    if (program == deleted)
+        program = UNKNOWN_NAME;
+}
+
+
+void RenderState::ForgetVertexArray(GLuint deleted)
+{
+    if (vertexArray == deleted)
+        vertexArray = UNKNOWN_NAME;
+}
+
+
+void RenderState::ForgetTexture(GLuint deleted)
+{
+    for (auto& unit : textures)
+    {
+        for (GLuint& texture : unit)
+        {
+            if (texture == deleted)
+                texture = UNKNOWN_NAME;
+        }
+    }
+}
+
+
+void RenderState::Invalidate()
+{
+    program = UNKNOWN_NAME;
+    vertexArray = UNKNOWN_NAME;
+    activeUnit = -1;
+    for (auto& unit : textures)
+    {
+        for (GLuint& texture : unit)
+            texture = UNKNOWN_NAME;
+    }
+    for (signed char& capability : capabilities)
+        capability = -1;
+}
+
+
+void RenderState::PrintStats() const
+{
+    unsigned long long total = issued + elided;
+    cout << "INFO: GL state calls: " << issued << " issued, " << elided << " elided";
+    if (total > 0)
+        cout << " (" << elided * 100 / total << "% redundant)";
+    cout << endl;
+}
@@ -0,0 +1,64 @@
+// RenderState.h
+// Shadows the GL binding and enable state the renderer touches most and
+// skips calls that would not change it. Every module binds programs,
+// vertex arrays and textures through URenderState() so the shadow copy
+// stays in sync with the context.
+
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <GL/glew.h>        // GLEW library
+
+// Texture units tracked by the cache
+const int RENDER_STATE_TEXTURE_UNITS = 16;
+// Unit used to bind textures for uploads, so creating or updating a texture
+// never disturbs the bindings draws are using
+const int RENDER_STATE_UPLOAD_UNIT = RENDER_STATE_TEXTURE_UNITS - 1;
+
+class RenderState
+{
+public:
+    RenderState() { Invalidate(); }
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vertexArray);
+    // Binds texture to target on unit, switching the active unit only when needed
+    void BindTexture(int unit, GLenum target, GLuint texture);
+    void Enable(GLenum capability);
+    void Disable(GLenum capability);
+
+    // Deleted objects are unbound by GL, and their names can be reused
+    void ForgetProgram(GLuint program);
+    void ForgetVertexArray(GLuint vertexArray);
+    void ForgetTexture(GLuint texture);
+
+    // Forgets everything, for after code that changes state behind the cache
+    void Invalidate();
+
+    unsigned long long IssuedCalls() const { return issued; }
+    unsigned long long ElidedCalls() const { return elided; }
+    void PrintStats() const;
+
+private:
+    // Texture targets and capabilities the cache knows about; others pass through
+    enum { TARGET_COUNT = 4, CAPABILITY_COUNT = 6 };
+    static int TargetIndex(GLenum target);
+    static int CapabilityIndex(GLenum capability);
+
+    void SetCapability(GLenum capability, bool enabled);
+    bool Elide(bool unchanged);
+
+    GLuint program;
+    GLuint vertexArray;
+    int activeUnit;
+    GLuint textures[RENDER_STATE_TEXTURE_UNITS][TARGET_COUNT];
+    signed char capabilities[CAPABILITY_COUNT];   // -1 unknown, 0 disabled, 1 enabled
+
+    unsigned long long issued = 0;
+    unsigned long long elided = 0;
+};
+
+// State cache of the (single) GL context
+RenderState& URenderState();
+
+#endif
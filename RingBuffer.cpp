@@ -0,0 +1,132 @@
+// RingBuffer.cpp
+// Persistently mapped per-frame buffer, see RingBuffer.h
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>         // cout, cerr
+
+#include "RingBuffer.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Coherent, so writes need no explicit flush before the draws that read them
+    const GLbitfield MAP_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    // Longest single wait before checking the fence again
+    const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+}
+
+
+bool RingBuffer::Create(size_t size)
+{
+    Destroy();
+
+    frameSize = size;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * RING_BUFFER_FRAMES, nullptr, MAP_FLAGS);
+    mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * RING_BUFFER_FRAMES, MAP_FLAGS));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!mapped)
+    {
+        cout << "Failed to map the ring buffer" << endl;
+        Destroy();
+        return false;
+    }
+
+    // BeginFrame moves to region 0 first
+    frame = RING_BUFFER_FRAMES - 1;
+    used = 0;
+    return true;
+}
+
+
+void RingBuffer::Destroy()
+{
+    for (GLsync& fence : fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (buffer)
+    {
+        if (mapped)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+    frameSize = used = 0;
+}
+
+
+void RingBuffer::BeginFrame()
+{
+    frame = (frame + 1) % RING_BUFFER_FRAMES;
+    used = 0;
+    ++frames;
+
+    GLsync& fence = fences[frame];
+    if (!fence)
+        return;
+
+    // Normally the GPU finished this region two frames ago and the first poll succeeds
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        ++stalls;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        do
+        {
+            result = glClientWaitSync(fence, flags, WAIT_TIMEOUT_NS);
+            flags = 0;
+        } while (result == GL_TIMEOUT_EXPIRED);
+        stallSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+
+void RingBuffer::EndFrame()
+{
+    if (buffer)
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
+void* RingBuffer::Allocate(size_t size, size_t alignment, GLintptr& offset)
+{
+    size_t start = (used + alignment - 1) / alignment * alignment;
+    if (!mapped || start + size > frameSize)
+    {
+        ++overflows;
+        return nullptr;
+    }
+
+    used = start + size;
+    peakUsed = std::max(peakUsed, used);
+    offset = GLintptr(frame * frameSize + start);
+    return mapped + offset;
+}
+
+
+void RingBuffer::PrintStats() const
+{
+    cout << "INFO: Ring buffer: " << RING_BUFFER_FRAMES << " x " << frameSize / 1024 << " KB, peak "
+         << peakUsed / 1024 << " KB per frame, " << stalls << " of " << frames << " frames waited for the GPU ("
+         << stallSeconds * 1000.0 << " ms)";
+    if (overflows)
+        cout << ", " << overflows << " allocations did not fit";
+    cout << endl;
+}
@@ -0,0 +1,62 @@
+// RingBuffer.h
+// Persistently mapped buffer for data the CPU rewrites every frame. The
+// buffer holds RING_BUFFER_FRAMES regions; each frame writes into its own
+// region through a pointer that stays mapped for the buffer's lifetime, and
+// a fence placed at the end of the frame tells a later frame when the GPU
+// is done reading it. With three regions the CPU can run up to two frames
+// ahead before it ever has to wait.
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <cstddef>
+
+// Frames in flight
+const int RING_BUFFER_FRAMES = 3;
+
+class RingBuffer
+{
+public:
+    RingBuffer() {}
+    ~RingBuffer() { Destroy(); }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Creates the buffer with frameSize bytes per frame
+    bool Create(size_t frameSize);
+    void Destroy();
+
+    // Moves to the next region, waiting for the GPU if it is still reading it
+    void BeginFrame();
+    // Fences the current region, once the frame's last draw reading it is issued
+    void EndFrame();
+
+    // Reserves size bytes of the current region. Returns the write pointer and
+    // the offset into the buffer for glBindBufferRange, or nullptr when the
+    // region is full.
+    void* Allocate(size_t size, size_t alignment, GLintptr& offset);
+
+    GLuint Id() const { return buffer; }
+    size_t FrameSize() const { return frameSize; }
+    void PrintStats() const;
+
+private:
+    GLuint buffer = 0;
+    unsigned char* mapped = nullptr;
+    size_t frameSize = 0;
+    GLsync fences[RING_BUFFER_FRAMES] = {};
+    int frame = 0;
+    size_t used = 0;            // bytes allocated from the current region
+
+    // stats
+    unsigned long long frames = 0;
+    unsigned long long stalls = 0;     // frames that had to wait for the GPU
+    double stallSeconds = 0.0;
+    size_t peakUsed = 0;
+    unsigned long long overflows = 0;
+};
+
+#endif
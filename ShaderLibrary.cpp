@@ -0,0 +1,245 @@
+// ShaderLibrary.cpp
+// File based shader programs with hot reload, see ShaderLibrary.h
+
+#include <chrono>
+#include <fstream>
+#include <iostream>         // cout, cerr
+#include <iterator>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "ShaderLibrary.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // How often files are checked when there is no change notification
+    const int POLL_INTERVAL_MS = 250;
+    // Editors save in several writes (or write and rename), let them finish
+    const int SETTLE_MS = 50;
+
+    bool readText(const string& filename, string& text)
+    {
+        ifstream in(filename, ios::binary);
+        if (!in)
+            return false;
+        text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Nothing but comments and whitespace may precede #version
+    void insertDefines(string& source, const string& defines)
+    {
+        if (defines.empty())
+            return;
+        size_t version = source.find("#version");
+        size_t lineEnd = version == string::npos ? string::npos : source.find('\n', version);
+        if (lineEnd == string::npos)
+            source = defines + source;
+        else
+            source.insert(lineEnd + 1, defines);
+    }
+}
+
+
+void ShaderLibrary::Add(ShaderProgram& program, const char* vtxFilename, const char* fragFilename, const string& defines)
+{
+    Entry entry;
+    entry.program = &program;
+    entry.vtxPath = string(SHADER_DIRECTORY) + "/" + vtxFilename;
+    entry.fragPath = string(SHADER_DIRECTORY) + "/" + fragFilename;
+    entry.defines = defines;
+    entries.push_back(entry);
+}
+
+
+void ShaderLibrary::AddCompute(ShaderProgram& program, const char* computeFilename, const string& defines)
+{
+    Entry entry;
+    entry.program = &program;
+    entry.vtxPath = string(SHADER_DIRECTORY) + "/" + computeFilename;
+    entry.defines = defines;
+    entries.push_back(entry);
+}
+
+
+bool ShaderLibrary::ReadSources(Entry& entry) const
+{
+    if (!readText(entry.vtxPath, entry.vtxSource) || (!entry.fragPath.empty() && !readText(entry.fragPath, entry.fragSource)))
+        return false;
+    insertDefines(entry.vtxSource, entry.defines);
+    insertDefines(entry.fragSource, entry.defines);
+    return true;
+}
+
+
+bool ShaderLibrary::Load()
+{
+    ShaderBatch batch;
+    bool computeCompiled = true;
+    for (Entry& entry : entries)
+    {
+        if (!ReadSources(entry))
+        {
+            cout << "Failed to read shader " << entry.vtxPath << " or " << entry.fragPath << endl;
+            return false;
+        }
+        // Compute programs are few and small, they compile on their own
+        if (entry.fragPath.empty())
+            computeCompiled = entry.program->CompileCompute(entry.vtxSource.c_str()) && computeCompiled;
+        // The strings stay put, entries are not added to after Load
+        else
+            batch.Add(*entry.program, entry.vtxSource.c_str(), entry.fragSource.c_str());
+    }
+    return batch.Compile() && computeCompiled;
+}
+
+
+bool ShaderLibrary::Watch(GLFWwindow* window)
+{
+    if (context)
+        return true;
+
+    // Same context hints as the window, which are still set, but never shown
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "shader reload", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context)
+    {
+        cout << "Failed to create the shader reload context, shaders will not reload" << endl;
+        return false;
+    }
+
+#ifdef __linux__
+    watchDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchDescriptor >= 0 &&
+        inotify_add_watch(watchDescriptor, SHADER_DIRECTORY, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        close(watchDescriptor);
+        watchDescriptor = -1;
+    }
+#endif
+
+    stopping = false;
+    worker = thread(&ShaderLibrary::Run, this);
+    cout << "INFO: Watching " << SHADER_DIRECTORY << " for shader changes ("
+         << (watchDescriptor >= 0 ? "inotify" : "polling") << ")" << endl;
+    return true;
+}
+
+
+int ShaderLibrary::Update()
+{
+    vector<Reloaded> swapped;
+    {
+        lock_guard<mutex> lock(readyMutex);
+        if (ready.empty())
+            return 0;
+        swapped.swap(ready);
+    }
+
+    // The new programs are complete (the reloader finished them), so the
+    // frame that first uses them does not wait for the driver
+    for (Reloaded& reloaded : swapped)
+    {
+        const Entry& entry = entries[reloaded.entry];
+        entry.program->Destroy();
+        *entry.program = reloaded.program;
+        cout << "INFO: Reloaded " << entry.vtxPath << (entry.fragPath.empty() ? "" : " + " + entry.fragPath) << endl;
+    }
+    return (int)swapped.size();
+}
+
+
+void ShaderLibrary::Stop()
+{
+    if (worker.joinable())
+    {
+        stopping = true;
+        worker.join();
+    }
+
+    // Finished programs nobody swapped in
+    for (Reloaded& reloaded : ready)
+        reloaded.program.Destroy();
+    ready.clear();
+
+    if (context)
+        glfwDestroyWindow(context);
+    context = nullptr;
+
+#ifdef __linux__
+    if (watchDescriptor >= 0)
+        close(watchDescriptor);
+#endif
+    watchDescriptor = -1;
+}
+
+
+void ShaderLibrary::Run()
+{
+    glfwMakeContextCurrent(context);
+    while (!stopping)
+    {
+        if (WaitForChange())
+            Reload();
+    }
+    glfwMakeContextCurrent(nullptr);
+}
+
+
+bool ShaderLibrary::WaitForChange()
+{
+#ifdef __linux__
+    if (watchDescriptor >= 0)
+    {
+        pollfd request = { watchDescriptor, POLLIN, 0 };
+        if (poll(&request, 1, POLL_INTERVAL_MS) <= 0)
+            return false;
+
+        // The events only wake us up, Reload compares the contents itself
+        char events[4096];
+        this_thread::sleep_for(chrono::milliseconds(SETTLE_MS));
+        while (read(watchDescriptor, events, sizeof(events)) > 0)
+            ;
+        return true;
+    }
+#endif
+    this_thread::sleep_for(chrono::milliseconds(POLL_INTERVAL_MS));
+    return true;
+}
+
+
+void ShaderLibrary::Reload()
+{
+    for (size_t i = 0; i < entries.size() && !stopping; ++i)
+    {
+        // Only this thread touches the sources once the library is watching
+        Entry& entry = entries[i];
+        Entry current = entry;
+        if (!ReadSources(current) || (current.vtxSource == entry.vtxSource && current.fragSource == entry.fragSource))
+            continue;
+        entry.vtxSource = current.vtxSource;
+        entry.fragSource = current.fragSource;
+
+        Reloaded reloaded;
+        reloaded.entry = i;
+        bool compiled = entry.fragPath.empty() ? reloaded.program.CompileCompute(entry.vtxSource.c_str())
+                                               : reloaded.program.Compile(entry.vtxSource.c_str(), entry.fragSource.c_str());
+        if (!compiled)
+        {
+            cout << "Keeping the previous " << entry.vtxPath << (entry.fragPath.empty() ? "" : " + " + entry.fragPath) << endl;
+            continue;
+        }
+
+        // Done on this context before the render thread may draw with it
+        glFinish();
+        lock_guard<mutex> lock(readyMutex);
+        ready.push_back(reloaded);
+    }
+}
@@ -0,0 +1,87 @@
+// ShaderLibrary.h
+// Shader programs built from the GLSL files in shaderfiles/. At startup the
+// files are read and every program is created in one ShaderBatch. While
+// the application runs, a background thread watches the files (inotify on
+// Linux, polling elsewhere), recompiles programs whose sources changed on a
+// hidden context that shares objects with the window's, and hands them
+// back; Update swaps them in between frames. A program whose new sources do
+// not compile keeps running with its previous version.
+
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <GL/glew.h>        // GLEW library
+#include <GLFW/glfw3.h>     // GLFW library
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShaderProgram.h"
+
+// Directory the shader files are read from, relative to the working directory
+const char* const SHADER_DIRECTORY = "shaderfiles";
+
+class ShaderLibrary
+{
+public:
+    ShaderLibrary() {}
+    ~ShaderLibrary() { Stop(); }
+
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+    // Registers a program built from two files in SHADER_DIRECTORY, before Load.
+    // defines are inserted into both sources after their #version line.
+    void Add(ShaderProgram& program, const char* vtxFilename, const char* fragFilename, const std::string& defines = "");
+    // Registers a compute program built from one file, reloaded the same way
+    void AddCompute(ShaderProgram& program, const char* computeFilename, const std::string& defines = "");
+    // Reads every file and creates all programs, false if a file is missing or a program fails
+    bool Load();
+
+    // Starts the background reloader. window must be current on the calling
+    // thread; the reloader's context is created here, on the main thread, as
+    // GLFW requires.
+    bool Watch(GLFWwindow* window);
+    // Swaps in programs the reloader finished. Call on the render thread
+    // between frames; returns the number of programs replaced.
+    int Update();
+    // Stops the reloader and destroys its context
+    void Stop();
+
+private:
+    struct Entry
+    {
+        ShaderProgram* program;
+        std::string vtxPath;    // the compute shader for compute programs
+        std::string fragPath;   // empty for compute programs
+        std::string defines;
+        std::string vtxSource;
+        std::string fragSource;
+    };
+
+    struct Reloaded
+    {
+        size_t entry;
+        ShaderProgram program;
+    };
+
+    bool ReadSources(Entry& entry) const;
+    void Run();
+    bool WaitForChange();
+    void Reload();
+
+    std::vector<Entry> entries;
+
+    GLFWwindow* context = nullptr;      // hidden, shares objects with the main window
+    std::thread worker;
+    std::atomic<bool> stopping{ false };
+    int watchDescriptor = -1;           // inotify instance, -1 when polling
+
+    std::mutex readyMutex;
+    std::vector<Reloaded> ready;
+};
+
+#endif
@@ -0,0 +1,355 @@
+// ShaderProgram.cpp
+// Shader compilation and uniform reflection, see ShaderProgram.h
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>         // cout, cerr
+#include <thread>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ProgramCache.h"
+#include "ShaderProgram.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Names of the UniformSlot values, in order
+    const char* const UNIFORM_SLOT_NAMES[UNIFORM_SLOT_COUNT] =
+    {
+        "uLightPosition", "uLightColor",
+        "uTextureArray", "uLayer", "uUvScale",
+        "uPhase", "uObjectCount", "uCommandCount", "uPyramid", "uPyramidSize", "uPyramidLevels",
+        "uSource", "uSourceLevel",
+        "uPageTable", "uPhysicalCache", "uVtVirtual", "uVtCache", "uVtLodBias"
+    };
+
+    // Prints the compile log of a shader that failed, returns false for it
+    bool checkShader(GLuint shaderId, const char* stage)
+    {
+        int success = 0;
+        glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[512];
+            glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::SHADER::" << stage << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+        }
+        return success != 0;
+    }
+}
+
+
+GLuint USubmitShaderProgram(const char* vtxShaderSource, const char* fragShaderSource)
+{
+    // Create a Shader program object.
+    GLuint programId = glCreateProgram();
+
+    // Create the vertex and fragment shader objects
+    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+    // Retrive the shader source
+    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
+    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+
+    // Compile both shaders without asking for their status: asking would wait
+    // for the compiler, linking does not
+    glCompileShader(vertexShaderId);
+    glCompileShader(fragmentShaderId);
+
+    // Attached compiled shaders to the shader program
+    glAttachShader(programId, vertexShaderId);
+    glAttachShader(programId, fragmentShaderId);
+
+    // Lets ProgramCache read the linked binary back
+    glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(programId);   // links the shader program
+    return programId;
+}
+
+
+GLuint USubmitComputeProgram(const char* computeShaderSource)
+{
+    GLuint programId = glCreateProgram();
+    GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderId, 1, &computeShaderSource, NULL);
+    glCompileShader(computeShaderId);
+    glAttachShader(programId, computeShaderId);
+    glLinkProgram(programId);
+    return programId;
+}
+
+
+bool UFinishShaderProgram(GLuint programId)
+{
+    // Compilation and linkage error reporting
+    int success = 0;
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+
+    GLuint shaders[2];
+    GLsizei shaderCount = 0;
+    glGetAttachedShaders(programId, 2, &shaderCount, shaders);
+
+    if (!success)
+    {
+        // A failed compile fails the link, report the shader's log first
+        bool compiled = true;
+        for (GLsizei i = 0; i < shaderCount; ++i)
+        {
+            GLint type = 0;
+            glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+            const char* stage = type == GL_VERTEX_SHADER ? "VERTEX" : (type == GL_COMPUTE_SHADER ? "COMPUTE" : "FRAGMENT");
+            compiled = checkShader(shaders[i], stage) && compiled;
+        }
+        if (compiled)
+        {
+            char infoLog[512];
+            glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        }
+    }
+
+    // The linked program does not need its shaders any more
+    for (GLsizei i = 0; i < shaderCount; ++i)
+    {
+        glDetachShader(programId, shaders[i]);
+        glDeleteShader(shaders[i]);
+    }
+
+    return success != 0;
+}
+
+
+// Implements the UCreateShaders function
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+{
+    programId = USubmitShaderProgram(vtxShaderSource, fragShaderSource);
+    if (!UFinishShaderProgram(programId))
+        return false;
+
+    URenderState().UseProgram(programId);    // Uses the shader program
+    return true;
+}
+
+
+void UDestroyShaderProgram(GLuint programId)
+{
+    URenderState().ForgetProgram(programId);
+    glDeleteProgram(programId);
+}
+
+void ShaderBatch::Add(ShaderProgram& program, const char* vtxShaderSource, const char* fragShaderSource)
+{
+    Job job;
+    job.program = &program;
+    job.vtxShaderSource = vtxShaderSource;
+    job.fragShaderSource = fragShaderSource;
+    job.programId = 0;
+    jobs.push_back(job);
+}
+
+
+bool ShaderBatch::Compile()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // Let the driver use as many compiler threads as it likes
+    bool parallel = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    for (Job& job : jobs)
+    {
+        job.program->Destroy();
+        job.programId = UProgramCache().BeginProgram(job.vtxShaderSource, job.fragShaderSource);
+    }
+
+    // Finish programs in the order they complete. Without the extension every
+    // program counts as complete and the first status query waits for it.
+    bool success = true;
+    vector<Job> waiting;
+    waiting.swap(jobs);
+    size_t programs = waiting.size();
+    while (!waiting.empty())
+    {
+        size_t remaining = 0;
+        for (Job& job : waiting)
+        {
+            GLint complete = GL_TRUE;
+            if (parallel)
+                glGetProgramiv(job.programId, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete)
+            {
+                waiting[remaining++] = job;
+                continue;
+            }
+
+            ShaderProgram& program = *job.program;
+            program.programId = job.programId;
+            if (UProgramCache().FinishProgram(job.vtxShaderSource, job.fragShaderSource, program.programId))
+                program.Reflect();
+            else
+            {
+                glDeleteProgram(program.programId);
+                program.programId = 0;
+                success = false;
+            }
+        }
+
+        waiting.resize(remaining);
+        if (!waiting.empty())
+            this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    cout << "INFO: Shader batch: " << programs << " programs, " << (parallel ? "parallel" : "serial") << " compile took "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    return success;
+}
+
+
+bool ShaderProgram::Create(const char* vtxShaderSource, const char* fragShaderSource)
+{
+    Destroy();
+    if (!UProgramCache().CreateProgram(vtxShaderSource, fragShaderSource, programId))
+    {
+        glDeleteProgram(programId);
+        programId = 0;
+        return false;
+    }
+
+    Reflect();
+    return true;
+}
+
+
+bool ShaderProgram::Compile(const char* vtxShaderSource, const char* fragShaderSource)
+{
+    Destroy();
+    programId = USubmitShaderProgram(vtxShaderSource, fragShaderSource);
+    if (!UFinishShaderProgram(programId))
+    {
+        glDeleteProgram(programId);
+        programId = 0;
+        return false;
+    }
+
+    Reflect();
+    return true;
+}
+
+
+bool ShaderProgram::CompileCompute(const char* computeShaderSource)
+{
+    Destroy();
+    programId = USubmitComputeProgram(computeShaderSource);
+    if (!UFinishShaderProgram(programId))
+    {
+        glDeleteProgram(programId);
+        programId = 0;
+        return false;
+    }
+
+    Reflect();
+    return true;
+}
+
+
+void ShaderProgram::Destroy()
+{
+    if (programId)
+        UDestroyShaderProgram(programId);
+    programId = 0;
+    uniforms.clear();
+    handles.clear();
+    ClearSlots();
+}
+
+
+void ShaderProgram::Reflect()
+{
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    vector<GLchar> name(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; ++i)
+    {
+        UniformInfo info;
+        GLsizei length = 0;
+        glGetActiveUniform(programId, (GLuint)i, (GLsizei)name.size(), &length, &info.size, &info.type, name.data());
+        info.name.assign(name.data(), length);
+        info.location = glGetUniformLocation(programId, info.name.c_str());
+
+        // Members of uniform blocks have no location and are set through their buffer
+        if (info.location < 0)
+            continue;
+
+        Handle handle = (Handle)uniforms.size();
+        uniforms.push_back(info);
+        handles[info.name] = handle;
+
+        // Arrays are reported as "name[0]", accept the bare name too
+        size_t bracket = info.name.rfind("[0]");
+        if (bracket != string::npos && bracket + 3 == info.name.size())
+            handles[info.name.substr(0, bracket)] = handle;
+    }
+
+    for (int slot = 0; slot < UNIFORM_SLOT_COUNT; ++slot)
+        slots[slot] = Uniform(UNIFORM_SLOT_NAMES[slot]);
+}
+
+
+ShaderProgram::Handle ShaderProgram::Uniform(const std::string& name) const
+{
+    auto found = handles.find(name);
+    return found != handles.end() ? found->second : INVALID_HANDLE;
+}
+
+
+void ShaderProgram::Set(Handle handle, int value) const
+{
+    if (handle >= 0)
+        glUniform1i(uniforms[handle].location, value);
+}
+
+
+void ShaderProgram::Set(Handle handle, float value) const
+{
+    if (handle >= 0)
+        glUniform1f(uniforms[handle].location, value);
+}
+
+
+void ShaderProgram::Set(Handle handle, const glm::vec2& value) const
+{
+    if (handle >= 0)
+        glUniform2fv(uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(Handle handle, const glm::vec3& value) const
+{
+    if (handle >= 0)
+        glUniform3fv(uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(Handle handle, const glm::vec4& value) const
+{
+    if (handle >= 0)
+        glUniform4fv(uniforms[handle].location, 1, glm::value_ptr(value));
+}
+
+
+void ShaderProgram::Set(Handle handle, const glm::mat4& value) const
+{
+    if (handle >= 0)
+        glUniformMatrix4fv(uniforms[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
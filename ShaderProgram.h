@@ -0,0 +1,143 @@
+// ShaderProgram.h
+// Linked GLSL program with its active uniforms reflected once after linking.
+// Uniforms are looked up by name through a hash table at setup time and set
+// by handle afterwards, so the render loop never asks the driver for a
+// location string.
+
+#ifndef SHADER_PROGRAM_H
+#define SHADER_PROGRAM_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "RenderState.h"
+
+// Compiles and links a vertex/fragment program
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+// The same in two steps: Submit issues compile and link without waiting on
+// the driver, Finish waits for the link status, reports errors and frees the
+// shaders. Drivers compile submitted programs in the background. Neither
+// touches the render state, only UCreateShaderProgram makes the program current.
+GLuint USubmitShaderProgram(const char* vtxShaderSource, const char* fragShaderSource);
+bool UFinishShaderProgram(GLuint programId);
+// Submit for a compute program, finished with UFinishShaderProgram too
+GLuint USubmitComputeProgram(const char* computeShaderSource);
+void UDestroyShaderProgram(GLuint programId);
+
+// Uniforms the frame loop sets on whatever program it is given. Reflect
+// resolves each into a slot of the program, so the loop reads a handle
+// instead of hashing a name; the slots move with the program when hot
+// reload swaps it.
+enum UniformSlot
+{
+    UNIFORM_LIGHT_POSITION,
+    UNIFORM_LIGHT_COLOR,
+    UNIFORM_TEXTURE_ARRAY,
+    UNIFORM_LAYER,
+    UNIFORM_UV_SCALE,
+    UNIFORM_PHASE,
+    UNIFORM_OBJECT_COUNT,
+    UNIFORM_COMMAND_COUNT,
+    UNIFORM_PYRAMID,
+    UNIFORM_PYRAMID_SIZE,
+    UNIFORM_PYRAMID_LEVELS,
+    UNIFORM_SOURCE,
+    UNIFORM_SOURCE_LEVEL,
+    UNIFORM_PAGE_TABLE,
+    UNIFORM_PHYSICAL_CACHE,
+    UNIFORM_VT_VIRTUAL,
+    UNIFORM_VT_CACHE,
+    UNIFORM_VT_LOD_BIAS,
+    UNIFORM_SLOT_COUNT
+};
+
+
+class ShaderProgram
+{
+public:
+    // Index into the program's uniform table, INVALID_HANDLE for uniforms the program lacks
+    typedef int Handle;
+    static const Handle INVALID_HANDLE = -1;
+
+    ShaderProgram() { ClearSlots(); }
+
+    // Links from the program cache when it holds these sources, compiles otherwise
+    bool Create(const char* vtxShaderSource, const char* fragShaderSource);
+    // Compiles without the program cache or the render state, so it can run on
+    // another thread's context that shares objects with the render context
+    bool Compile(const char* vtxShaderSource, const char* fragShaderSource);
+    // Compute programs, compiled like Compile (the program cache keys vertex/fragment pairs)
+    bool CompileCompute(const char* computeShaderSource);
+    void Destroy();
+
+    GLuint Id() const { return programId; }
+    void Use() const { URenderState().UseProgram(programId); }
+
+    // Resolves a uniform name to a handle (hashed, no GL call). Arrays answer
+    // to both "name" and "name[0]".
+    Handle Uniform(const std::string& name) const;
+    // The handle Reflect resolved for a slot, no lookup at all
+    Handle Uniform(UniformSlot slot) const { return slots[slot]; }
+    size_t UniformCount() const { return uniforms.size(); }
+
+    // Setters for the currently used program. Invalid handles are ignored, like
+    // location -1 is by glUniform*.
+    void Set(Handle handle, int value) const;
+    void Set(Handle handle, float value) const;
+    void Set(Handle handle, const glm::vec2& value) const;
+    void Set(Handle handle, const glm::vec3& value) const;
+    void Set(Handle handle, const glm::vec4& value) const;
+    void Set(Handle handle, const glm::mat4& value) const;
+
+private:
+    friend class ShaderBatch;
+
+    struct UniformInfo
+    {
+        std::string name;
+        GLint location;
+        GLenum type;
+        GLint size;             // array length, 1 for plain uniforms
+    };
+
+    void Reflect();
+    void ClearSlots() { for (Handle& slot : slots) slot = INVALID_HANDLE; }
+
+    GLuint programId = 0;
+    std::vector<UniformInfo> uniforms;
+    std::unordered_map<std::string, Handle> handles;
+    Handle slots[UNIFORM_SLOT_COUNT];
+};
+
+
+// Creates many programs at once. Every program is handed to the driver
+// before any status is queried; with KHR_parallel_shader_compile the driver
+// compiles them on its own threads and each is finished as soon as it
+// reports completion, so startup waits for the slowest program rather than
+// the sum of all of them.
+class ShaderBatch
+{
+public:
+    // Queues program for creation, the sources must stay valid until Compile
+    void Add(ShaderProgram& program, const char* vtxShaderSource, const char* fragShaderSource);
+    // Creates every queued program, false if any failed
+    bool Compile();
+
+private:
+    struct Job
+    {
+        ShaderProgram* program;
+        const char* vtxShaderSource;
+        const char* fragShaderSource;
+        GLuint programId;
+    };
+
+    std::vector<Job> jobs;
+};
+
+#endif
@@ -0,0 +1,87 @@
+// ShaderVariants.cpp
+// Shader permutations, see ShaderVariants.h
+
+#include <iostream>         // cout, cerr
+
+#include "ShaderVariants.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Define names, in ShaderFeature bit order
+    const char* const FEATURE_NAMES[SHADER_FEATURE_COUNT] = { "TEXTURED", "LIT", "INSTANCED", "DERIVED_NORMALS" };
+}
+
+
+ShaderFeatures UMinimalFeatures(ShaderFeatures features)
+{
+    if (!(features & SHADER_FEATURE_LIT))
+        features &= ~SHADER_FEATURE_DERIVED_NORMALS;
+    return features;
+}
+
+
+string UShaderDefines(ShaderFeatures features)
+{
+    string defines;
+    for (int i = 0; i < SHADER_FEATURE_COUNT; ++i)
+    {
+        if (features & (1u << i))
+            defines += string("#define ") + FEATURE_NAMES[i] + "\n";
+    }
+    return defines;
+}
+
+
+ShaderVariants::ShaderVariants(ShaderLibrary& shaderLibrary, const char* vtxFile, const char* fragFile)
+    : library(shaderLibrary), vtxFilename(vtxFile), fragFilename(fragFile)
+{
+}
+
+
+ShaderProgram& ShaderVariants::Require(ShaderFeatures features)
+{
+    features = UMinimalFeatures(features);
+    auto found = variants.find(features);
+    if (found != variants.end())
+        return *found->second;
+
+    unique_ptr<ShaderProgram>& program = variants[features];
+    program.reset(new ShaderProgram());
+    library.Add(*program, vtxFilename.c_str(), fragFilename.c_str(), UShaderDefines(features));
+    return *program;
+}
+
+
+ShaderProgram* ShaderVariants::Find(ShaderFeatures features) const
+{
+    auto found = variants.find(UMinimalFeatures(features));
+    return found != variants.end() ? found->second.get() : nullptr;
+}
+
+
+void ShaderVariants::Destroy()
+{
+    for (auto& variant : variants)
+        variant.second->Destroy();
+}
+
+
+void ShaderVariants::PrintStats() const
+{
+    cout << "INFO: " << vtxFilename << " + " << fragFilename << ": " << variants.size() << " of "
+         << (1 << SHADER_FEATURE_COUNT) << " variants built";
+    for (const auto& variant : variants)
+    {
+        cout << (variant.first == variants.begin()->first ? " (" : ", ");
+        if (!variant.first)
+            cout << "base";
+        for (int i = 0, listed = 0; i < SHADER_FEATURE_COUNT; ++i)
+        {
+            if (variant.first & (1u << i))
+                cout << (listed++ ? "+" : "") << FEATURE_NAMES[i];
+        }
+    }
+    cout << (variants.empty() ? "" : ")") << endl;
+}
@@ -0,0 +1,64 @@
+// ShaderVariants.h
+// Permutations of one vertex/fragment source pair. The sources declare
+// their optional features with #ifdef; a variant is the program built with
+// one combination of them defined. Variants are keyed by their feature
+// bitmask, created once through the ShaderLibrary (so they compile in the
+// startup batch and hot reload like any other program), and the renderer
+// asks for the smallest variant that covers what a draw needs.
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "ShaderLibrary.h"
+#include "ShaderProgram.h"
+
+enum ShaderFeature
+{
+    SHADER_FEATURE_TEXTURED = 1 << 0,           // samples the scene texture array
+    SHADER_FEATURE_LIT = 1 << 1,                // lit by the point light
+    SHADER_FEATURE_INSTANCED = 1 << 2,          // per-draw data from the static pool
+    SHADER_FEATURE_DERIVED_NORMALS = 1 << 3,    // normals from position derivatives
+    SHADER_FEATURE_COUNT = 4
+};
+typedef unsigned ShaderFeatures;
+
+// Drops features that have no effect in the combination (normals only
+// matter when lit), so equivalent requests share one variant
+ShaderFeatures UMinimalFeatures(ShaderFeatures features);
+// "#define TEXTURED\n..." for the set features
+std::string UShaderDefines(ShaderFeatures features);
+
+class ShaderVariants
+{
+public:
+    // Variants of vtxFilename + fragFilename, created through library
+    ShaderVariants(ShaderLibrary& library, const char* vtxFilename, const char* fragFilename);
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // Returns the variant for features, registering it with the library the
+    // first time. Register every variant before the library's Load.
+    ShaderProgram& Require(ShaderFeatures features);
+    // The variant for features, nullptr if it was never required
+    ShaderProgram* Find(ShaderFeatures features) const;
+
+    // Destroys every variant's program
+    void Destroy();
+
+    size_t Count() const { return variants.size(); }
+    void PrintStats() const;
+
+private:
+    ShaderLibrary& library;
+    std::string vtxFilename;
+    std::string fragFilename;
+    // Programs stay at the same address, the library points at them
+    std::map<ShaderFeatures, std::unique_ptr<ShaderProgram>> variants;
+};
+
+#endif
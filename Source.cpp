@@ -1,10 +1,33 @@
+#include <algorithm>        // max
 #include <iostream>         // cout, cerr
+#include <cctype>           // isdigit
+#include <cmath>            // tan
 #include <cstdlib>          // EXIT_FAILURE
+#include <string>           // string
+#include <vector>           // vector
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"    // Image loading Utility functions
+#include "CameraBuffer.h"   // Shared per-frame camera uniforms
+#include "Culling.h"        // Bounding volumes and frustum tests
+#include "MeshFile.h"       // Binary mesh files
+#include "MeshHeap.h"       // Suballocated buffers for run time meshes
+#include "MeshImport.h"     // OBJ and glTF models
+#include "Meshlet.h"        // Triangle clusters culled by facing
+#include "Occlusion.h"      // GPU occlusion culling against a depth pyramid
+#include "Profile.h"        // CPU frame timing
+#include "ProgramCache.h"   // Linked program binaries kept between runs
+#include "RenderQueue.h"    // Sorted draw submission
+#include "RenderState.h"    // Redundant state call elimination
+#include "ShaderLibrary.h"  // Shader files with hot reload
+#include "ShaderProgram.h"  // Programs with reflected uniforms
+#include "ShaderVariants.h" // Feature permutations of the surface shaders
 #include "Sphere.h"
+#include "StaticGeometry.h"  // Multi-draw indirect geometry pool
+#include "Benchmark.h"      // Synthetic benchmark meshes
+#include "Bvh.h"            // Scene hierarchy for culling and picking
+#include "TextureArray.h" // Scene textures packed into one array
+#include "VertexLayout.h"   // Compile-time vertex formats
+#include "VirtualTexture.h" // Paged planet textures
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
@@ -32,9 +55,13 @@ namespace
     // Stores the GL data relative to a given mesh
     struct GLMesh
     {
-        GLuint vao;         // Handle for the vertex array object
-        GLuint vbo;         // Handle for the vertex buffer object
+        GLuint vao = 0;     // Handle for the vertex array object (gMeshHeap's)
         GLuint nVertices;    // Number of indices of the mesh
+        GLuint nIndices = 0; // Number of indices in the element buffer (indexed meshes only)
+        MeshAllocation allocation;  // Vertex and index ranges in gMeshHeap
+        int poolMesh = -1;   // Mesh id in gStaticGeometry for static meshes (which have no VAO)
+        const MeshletMesh* meshlets = nullptr;  // Clusters the indices are ordered by, culled each frame
+        Bounds bounds;       // Box and sphere in mesh units, for frustum culling
     };
 
     // Main GLFW window
@@ -44,17 +71,55 @@ namespace
     GLMesh gPlaneMesh;
     GLMesh gFloorMesh;
     GLMesh gLightMesh;
-    // Texture id
+    GLMesh gPlanetMesh;
+    // Planet triangles in meshlets, so the side facing away is never drawn
+    MeshletMesh gPlanetMeshlets;
+    bool gUseMeshlets = true;       // --no-meshlets draws the whole sphere
+    // Texture layers
     //GLuint gTextureId;
-    GLuint gPlane;
-    GLuint gFloor;
-    GLuint gWalls;
-    GLuint gPlanet1;
-    
+    int gPlane;
+    int gFloor;
+    int gWalls;
+    int gPlanet1 = -1;
+    // Every scene image in one texture array, so draws only switch layers
+    TextureArray gSceneTextures;
+    // Planet surface streamed from a page file, when one exists
+    const char* const PLANET_PAGE_FILE = "mars.vtex";
+    VirtualTexture gPlanetVT;
+
     // Shader program
-    GLuint gProgramId;
+    ShaderLibrary gShaders;     // builds the programs from shaderfiles/ and reloads them on change
+    // Surface shader variants, each draw uses the one with just the features it needs
+    ShaderVariants gSurfaces(gShaders, "surface.vs", "surface.fs");
+    ShaderFeatures gStaticFeatures = 0;
+    ShaderFeatures gPlanetFeatures = 0;
+    ShaderFeatures gExtraPlanetFeatures = 0;   // --planets always use the regular texture
+    bool gLit = false;          // --lit: the lamp lights the scene
     GLuint gCubeProgramId;
-    GLuint gLampProgramId;
+    ShaderProgram gPlanetProgram;
+    ShaderProgram gPlanetFeedbackProgram;
+
+    // View and projection for every program, uploaded once per frame
+    CameraBuffer gCameraBuffer;
+
+    // Walls, plane, floor and lamp (plus the benchmark meshes) in one indirect draw
+    StaticGeometryPool gStaticGeometry;
+    // Vertex and index buffers shared by the meshes drawn through the render queue
+    MeshHeap gMeshHeap;
+    bool gDrawStaticDirect = false;     // one call per draw instead, for comparison
+
+    // Static meshes are read from MESH_DIRECTORY/<name>.mesh when the file exists,
+    // otherwise built from the vertices below; --export-meshes writes those files
+    const char* const MESH_DIRECTORY = "meshes";
+    const char* gMeshExportDirectory = nullptr;
+    bool gMeshExportFailed = false;
+
+    // Frame draws, sorted by state and depth
+    RenderQueue gRenderQueue;
+    const float FAR_PLANE = 100.0f;
+
+    // CPU time spent in URender, reported every few seconds
+    FrameProfile gProfile;
 
     // camera
     Camera gCamera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -86,7 +151,164 @@ namespace
     // Lamp animation
     bool gIsLampOrbiting = false;
 
-    
+    // Planet position and scale, outside the window
+    glm::vec3 gPlanetPosition(0.35f, -0.1f, -4.0f);
+    glm::vec3 gPlanetScale(1.5f);
+
+    // --planets N: more planets on a grid beyond the window, drawn with the
+    // scene texture (no meshlets or virtual texture)
+    const float EXTRA_PLANET_SPACING = 3.0f;
+    const float EXTRA_PLANET_SCALE = 0.6f;
+    std::vector<glm::mat4> gExtraPlanets;
+    // World space spheres of every planet, [0] is the one outside the window
+    SphereSet gPlanetSpheres;
+    std::vector<unsigned char> gPlanetVisible;
+
+    // Static draws and planets in one hierarchy, for culling and for picking
+    // what is under the crosshair. --flat-cull tests every sphere instead.
+    Bvh gSceneBvh;
+    std::vector<unsigned char> gSceneVisible;
+    size_t gFirstPlanetObject = 0;      // static draws come first
+    bool gFlatCulling = false;
+
+    // The same objects tested on the GPU against last frame's visible set and
+    // a depth pyramid, so whatever the room's walls hide is not drawn.
+    // --no-occlusion (or --direct) draws everything in the frustum.
+    OcclusionCuller gOcclusion;
+    ShaderProgram gHizProgram;
+    ShaderProgram gOcclusionProgram;
+    bool gUseOcclusion = true;
+
+    // Sphere poles are along z, stand the planet upright
+    glm::mat4 planetTransform(const glm::vec3& position, const glm::vec3& scale)
+    {
+        return glm::translate(position) * glm::rotate(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * glm::scale(scale);
+    }
+
+    // Queue entry drawing a whole mesh, layer is the mesh's texture in gSceneTextures
+    DrawItem meshDraw(const GLMesh& mesh, const ShaderProgram& program, const glm::mat4& model, int layer = -1)
+    {
+        DrawItem item;
+        item.program = &program;
+        item.model = model;
+        item.vertexArray = mesh.vao;
+        item.indexed = mesh.nIndices != 0;
+        item.count = item.indexed ? mesh.nIndices : mesh.nVertices;
+        item.baseVertex = mesh.allocation.baseVertex;
+        item.firstIndex = mesh.allocation.firstIndex;
+        item.meshlets = mesh.meshlets;
+        if (layer >= 0)
+        {
+            item.textures = &gSceneTextures;
+            item.layer = layer;
+        }
+        return item;
+    }
+
+    // The draw is skipped when the GPU found the scene object occluded
+    DrawItem occludable(DrawItem item, size_t object)
+    {
+        if (gUseOcclusion)
+        {
+            item.visibility = gOcclusion.VisibilityBuffer();
+            item.visibilityIndex = (GLuint)object;
+        }
+        return item;
+    }
+
+    // Adds a static mesh to the pool from its mesh file, or from the built-in
+    // vertices (unindexed, with the given layout) when there is none
+    void addStaticMesh(GLMesh& mesh, const char* name, const GLfloat* verts, GLuint vertexCount, const PoolVertexLayout& layout)
+    {
+        std::string filename = std::string(gMeshExportDirectory ? gMeshExportDirectory : MESH_DIRECTORY) + "/" + name + ".mesh";
+        if (gMeshExportDirectory)
+        {
+            if (USaveMeshFile(filename.c_str(), verts, vertexCount, layout))
+                cout << "INFO: Wrote " << filename << endl;
+            else
+                gMeshExportFailed = true;
+            return;
+        }
+
+        // The pool copies straight out of the mapping
+        MeshFile file;
+        if (file.Open(filename.c_str()))
+        {
+            const MeshFileHeader& header = file.Header();
+            mesh.nVertices = header.vertexCount;
+            mesh.poolMesh = gStaticGeometry.AddMesh(file.Vertices(), header.vertexCount, file.Layout(), file.Indices(), header.indexCount);
+            cout << "INFO: Loaded " << filename << endl;
+        }
+        else
+            mesh.poolMesh = gStaticGeometry.AddMesh(verts, vertexCount, layout);
+    }
+
+    // Planet 0 is the one outside the window, the rest come from --planets
+    glm::mat4 planetModelOf(size_t planet)
+    {
+        return planet == 0 ? planetTransform(gPlanetPosition, gPlanetScale) : gExtraPlanets[planet - 1];
+    }
+
+    // Distance along a normalized ray to where it enters the sphere, false when it misses
+    bool raySphere(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& center, float radius, float& distance)
+    {
+        glm::vec3 toCenter = center - origin;
+        float along = glm::dot(toCenter, direction);
+        float missSquared = glm::dot(toCenter, toCenter) - along * along;
+        if (missSquared > radius * radius)
+            return false;
+        float halfChord = sqrt(radius * radius - missSquared);
+        distance = along - halfChord >= 0.0f ? along - halfChord : along + halfChord;
+        return distance >= 0.0f;
+    }
+
+    // Reports the nearest object under the crosshair; the cursor is captured,
+    // so that is the middle of the view
+    void pickCrosshair()
+    {
+        glm::vec3 origin = gCamera.Position;
+        glm::vec3 direction = glm::normalize(gCamera.Front);
+        float distance = 0.0f;
+        int object = gSceneBvh.Raycast(origin, direction, FAR_PLANE, distance, [&](int hit, float& hitDistance)
+        {
+            // Static draws are hit on their triangles, planets on their sphere
+            if (hit < (int)gFirstPlanetObject)
+                return gStaticGeometry.Raycast(hit, origin, direction, FAR_PLANE, hitDistance);
+            glm::vec3 center;
+            float radius;
+            UTransformSphere(gPlanetMesh.bounds, planetModelOf(hit - gFirstPlanetObject), center, radius);
+            return raySphere(origin, direction, center, radius, hitDistance);
+        });
+
+        if (object < 0)
+            cout << "INFO: Nothing under the crosshair" << endl;
+        else if (object < (int)gFirstPlanetObject)
+            cout << "INFO: Picked static draw " << object << " at distance " << distance << endl;
+        else
+            cout << "INFO: Picked planet " << object - gFirstPlanetObject << " at distance " << distance << endl;
+    }
+
+    // Point light of the lit surface variants, the other variants ignore it
+    void setLight(const ShaderProgram& program)
+    {
+        if (!gLit)
+            return;
+        program.Set(program.Uniform(UNIFORM_LIGHT_POSITION), gLightPosition);
+        program.Set(program.Uniform(UNIFORM_LIGHT_COLOR), gLightColor);
+    }
+
+    // Binds the scene textures and light of a surface variant main required,
+    // nullptr when it did not
+    const ShaderProgram* useSurface(ShaderFeatures features)
+    {
+        const ShaderProgram* program = gSurfaces.Find(features);
+        if (!program)
+            return nullptr;
+        program->Use();
+        gSceneTextures.Bind(*program, 0);
+        setLight(*program);
+        return program;
+    }
 }
 
 /* User-defined Function prototypes to:
@@ -104,43 +326,12 @@ void UCreateMesh(GLMesh& mesh);
 void UCreatePlaneMesh(GLMesh& mesh);
 void UCreateFloorMesh(GLMesh& mesh);
 void UCreateLightMesh(GLMesh& mesh);
+void UCreateSphereMesh(GLMesh& mesh, const Sphere& sphere);
 void UDestroyMesh(GLMesh& mesh);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
 
 Sphere S(1, 30, 30);
 
-/* Lamp Shader Source Code*/
-const GLchar* lampVertexShaderSource = GLSL(440,
-
-    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
-
-        //Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-}
-);
-
-
-/* Fragment Shader Source Code*/
-const GLchar* lampFragmentShaderSource = GLSL(440,
-
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
-
-void main()
-{
-    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
-}
-);
-
 /* Vertex Shader Source Code
 const GLchar* vertexShaderSource = GLSL(440,
     layout(location = 0) in vec3 aPos;
@@ -168,118 +359,230 @@ void main()
 }
 );
 */
-/* Vertex Shader Source Code*/
-const GLchar* vertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position;
-layout(location = 2) in vec2 textureCoordinate;
-
-out vec2 vertexTextureCoordinate;
-
-
-//Global variables for the transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(position, 1.0f); // transforms vertices to clip coordinates
-    vertexTextureCoordinate = textureCoordinate;
-}
-);
-
-/* Fragment Shader Source Code*/
-const GLchar* fragmentShaderSource = GLSL(440,
-    in vec2 vertexTextureCoordinate;
-
-out vec4 fragmentColor;
-
-uniform sampler2D uTexture;
 
-void main()
+int main(int argc, char* argv[])
 {
-    fragmentColor = texture(uTexture, vertexTextureCoordinate); // Sends texture to the GPU for rendering
-}
-);
+    // Offline step: tile a large image into a page file for virtual texturing
+    if (argc == 4 && std::string(argv[1]) == "--build-vt")
+        return UBuildPageFile(argv[2], argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{
-    for (int j = 0; j < height / 2; ++j)
+    // Offline step: write the built-in static meshes as mesh files, --export-meshes [directory]
+    if (argc >= 2 && std::string(argv[1]) == "--export-meshes")
     {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
+        gMeshExportDirectory = argc >= 3 ? argv[2] : MESH_DIRECTORY;
+        UCreateMesh(gMesh);
+        UCreatePlaneMesh(gPlaneMesh);
+        UCreateFloorMesh(gFloorMesh);
+        UCreateLightMesh(gLightMesh);
+        return gMeshExportFailed ? EXIT_FAILURE : EXIT_SUCCESS;
     }
-}
 
+    // Benchmark: --benchmark [meshes] adds thousands of distinct static meshes,
+    // --direct draws the static pool with one call per mesh instead of one indirect call
+    int benchmarkMeshes = 0;
+    // --import <file> adds an .obj, .gltf or .glb model to the room, repeatable
+    std::vector<std::string> importFiles;
+    // --no-lod draws every static mesh at full detail, --no-meshlets the whole planet,
+    // --planets N adds N planets beyond the window, --flat-cull culls without the BVH,
+    // --no-occlusion skips the GPU occlusion culling
+    bool buildLods = true;
+    int extraPlanets = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--benchmark")
+            benchmarkMeshes = (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) ? atoi(argv[++i]) : 4096;
+        else if (arg == "--direct")
+            gDrawStaticDirect = true;
+        else if (arg == "--lit")
+            gLit = true;
+        else if (arg == "--import" && i + 1 < argc)
+            importFiles.push_back(argv[++i]);
+        else if (arg == "--no-lod")
+            buildLods = false;
+        else if (arg == "--no-meshlets")
+            gUseMeshlets = false;
+        else if (arg == "--planets" && i + 1 < argc)
+            extraPlanets = atoi(argv[++i]);
+        else if (arg == "--flat-cull")
+            gFlatCulling = true;
+        else if (arg == "--no-occlusion")
+            gUseOcclusion = false;
+    }
+    // The phases draw the pool from the commands the GPU writes
+    if (gDrawStaticDirect)
+        gUseOcclusion = false;
 
-int main(int argc, char* argv[])
-{
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
+    // Meshes created while running share the heap's buffers
+    if (!gMeshHeap.Create())
+        return EXIT_FAILURE;
+
     // Create the mesh
     UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
     UCreatePlaneMesh(gPlaneMesh);
     UCreateFloorMesh(gFloorMesh);
     //create light mesh
     UCreateLightMesh(gLightMesh);
+    UCreateSphereMesh(gPlanetMesh, S);
+
+    // Every planet's sphere; the first follows the planet each frame, the rest never move
+    gPlanetSpheres.Add(glm::vec3(0.0f), 0.0f);
+    int planetColumns = (int)ceil(sqrt((double)max(extraPlanets, 0)));
+    for (int i = 0; i < extraPlanets; ++i)
+    {
+        int column = i % planetColumns, row = i / planetColumns;
+        glm::vec3 position((column - (planetColumns - 1) * 0.5f) * EXTRA_PLANET_SPACING,
+                           ((column + row) % 3 - 1) * EXTRA_PLANET_SPACING * 0.5f,
+                           -10.0f - row * EXTRA_PLANET_SPACING);
+        gExtraPlanets.push_back(planetTransform(position, glm::vec3(EXTRA_PLANET_SCALE)));
+
+        glm::vec3 center;
+        float radius;
+        UTransformSphere(gPlanetMesh.bounds, gExtraPlanets.back(), center, radius);
+        gPlanetSpheres.Add(center, radius);
+    }
+    if (extraPlanets > 0)
+        cout << "INFO: Added " << extraPlanets << " planets" << endl;
+
+    // Imported models go into the static pool like the built-in meshes
+    std::vector<int> importedMeshes;
+    for (const std::string& filename : importFiles)
+    {
+        ImportedMesh imported;
+        if (!UImportMesh(filename.c_str(), imported))
+            continue;
+        importedMeshes.push_back(gStaticGeometry.AddMesh(imported.vertices.data(), imported.VertexCount(), imported.Layout(),
+                                                         imported.indices.data(), imported.indices.size()));
+    }
 
  
      // Create the shader programs
      //if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gCubeProgramId))
       //  return EXIT_FAILURE;
-     if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    if (!gCameraBuffer.Create())
         return EXIT_FAILURE;
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    if (!gRenderQueue.Create())
         return EXIT_FAILURE;
+    gRenderQueue.AttachVertexArray(gMeshHeap.VertexArray());
 
     // Load wall texture
     const char* texFilename = "purple.jpg";
-    if (!UCreateTexture(texFilename, gWalls))
+    gWalls = gSceneTextures.Add(texFilename);
+    if (gWalls < 0)
     {
         cout << "Failed to load texture " << texFilename << endl;
         return EXIT_FAILURE;
     }
     // Load plane texture
     const char* texFilename2 = "stars.jpg";
-    if (!UCreateTexture(texFilename2, gPlane))
+    gPlane = gSceneTextures.Add(texFilename2);
+    if (gPlane < 0)
     {
         cout << "Failed to load texture " << texFilename2 << endl;
         return EXIT_FAILURE;
     }
     // Load plane texture
     const char* texFilename3 = "floor.jpeg";
-    if (!UCreateTexture(texFilename3, gFloor))
+    gFloor = gSceneTextures.Add(texFilename3);
+    if (gFloor < 0)
     {
         cout << "Failed to load texture " << texFilename3 << endl;
         return EXIT_FAILURE;
     }
-    //load planet1 texture
-    const char* texFilename4 = "mars.jpg";
-    if (!UCreateTexture(texFilename4, gPlanet1))
+    //load planet1 texture: paged when a page file exists, otherwise a regular
+    //texture, which the extra planets use either way
+    if (gPlanetVT.Open(PLANET_PAGE_FILE, 16, WINDOW_WIDTH / 8, WINDOW_HEIGHT / 8))
+        gPlanetVT.PrintStats();
+    if (!gPlanetVT.IsOpen() || !gExtraPlanets.empty())
+    {
+        const char* texFilename4 = "mars.jpg";
+        gPlanet1 = gSceneTextures.Add(texFilename4);
+        if (gPlanet1 < 0)
+        {
+            cout << "Failed to load texture " << texFilename4 << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!gSceneTextures.Build())
+    {
+        cout << "Failed to create the scene texture array" << endl;
+        return EXIT_FAILURE;
+    }
+    gSceneTextures.PrintStats();
+
+    // Pick the variant of every draw now that the meshes and textures are
+    // known, then compile just those. The pool is one draw; it only derives
+    // normals per pixel if some mesh had nothing to generate them from.
+    ShaderFeatures lighting = gLit ? SHADER_FEATURE_LIT : 0;
+    gStaticFeatures = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_INSTANCED | lighting;
+    if (!gStaticGeometry.HasNormals())
+        gStaticFeatures |= SHADER_FEATURE_DERIVED_NORMALS;
+    gPlanetFeatures = (gPlanetVT.IsOpen() ? 0 : SHADER_FEATURE_TEXTURED) | lighting;
+    gExtraPlanetFeatures = SHADER_FEATURE_TEXTURED | lighting;
+
+    UProgramCache().Open();
+    gSurfaces.Require(gStaticFeatures);
+    if (gPlanetVT.IsOpen())
+    {
+        // The planet's own fragment shaders only need the texture coordinates
+        std::string planetDefines = UShaderDefines(SHADER_FEATURE_TEXTURED);
+        gShaders.Add(gPlanetProgram, "surface.vs", "planet.fs", planetDefines);
+        gShaders.Add(gPlanetFeedbackProgram, "surface.vs", "planet_feedback.fs", planetDefines);
+    }
+    else
+        gSurfaces.Require(gPlanetFeatures);
+    if (!gExtraPlanets.empty())
+        gSurfaces.Require(gExtraPlanetFeatures);
+    if (gUseOcclusion)
     {
-        cout << "Failed to load texture " << texFilename4 << endl;
+        gShaders.AddCompute(gHizProgram, "hiz.comp");
+        gShaders.AddCompute(gOcclusionProgram, "occlusion_cull.comp");
+    }
+    if (!gShaders.Load())
+        return EXIT_FAILURE;
+    if (!UProgramCache().Save())
+        cout << "Failed to write the program cache " << PROGRAM_CACHE_FILE << endl;
+    UProgramCache().PrintStats();
+    gSurfaces.PrintStats();
+
+    // Static scene: the room is scaled by 2 around the origin
+    glm::mat4 roomModel = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
+    gStaticGeometry.AddDraw(gMesh.poolMesh, roomModel, gWalls);
+    gStaticGeometry.AddDraw(gPlaneMesh.poolMesh, roomModel, gPlane);
+    gStaticGeometry.AddDraw(gFloorMesh.poolMesh, roomModel, gFloor);
+    gStaticGeometry.AddDraw(gLightMesh.poolMesh, glm::translate(gLightPosition) * glm::scale(gLightScale), -1);
+    for (int mesh : importedMeshes)
+        gStaticGeometry.AddDraw(mesh, glm::mat4(1.0f), gWalls);
+    if (benchmarkMeshes > 0)
+        UAddBenchmarkMeshes(gStaticGeometry, benchmarkMeshes, gSceneTextures.LayerCount());
+    if (buildLods)
+        gStaticGeometry.BuildLods();
+    if (!gStaticGeometry.Build(gSceneTextures))
+    {
+        cout << "Failed to create the static geometry" << endl;
         return EXIT_FAILURE;
     }
+    gStaticGeometry.PrintStats();
+
+    // Objects of the scene hierarchy: every static draw, then every planet
+    std::vector<Aabb> sceneBoxes;
+    for (size_t draw = 0; draw < gStaticGeometry.DrawCount(); ++draw)
+        sceneBoxes.push_back(gStaticGeometry.DrawBox(draw));
+    gFirstPlanetObject = sceneBoxes.size();
+    for (size_t planet = 0; planet <= gExtraPlanets.size(); ++planet)
+        sceneBoxes.push_back(UTransformBox(gPlanetMesh.bounds, planetModelOf(planet)));
+    gSceneBvh.Build(sceneBoxes);
+    gSceneBvh.PrintStats();
+    if (gUseOcclusion)
+        gOcclusion.Create(sceneBoxes, gStaticGeometry.CommandBuffer(), gStaticGeometry.DrawCount());
 
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gProgramId);
-    glUseProgram(gLampProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gProgramId, "uTexture"), 0);
-    glUniform1i(glGetUniformLocation(gLampProgramId, "uTexture"), 0);
 
 
+    // Shader edits show up without a restart
+    gShaders.Watch(gWindow);
 
     // render loop
     // -----------
@@ -295,6 +598,9 @@ int main(int argc, char* argv[])
         // -----
         UProcessInput(gWindow);
 
+        // Programs recompiled in the background replace the old ones between frames
+        gShaders.Update();
+
         // Render this frame
         URender();
 
@@ -306,15 +612,41 @@ int main(int argc, char* argv[])
     UDestroyMesh(gPlaneMesh);
     UDestroyMesh(gFloorMesh);
     UDestroyMesh(gLightMesh);
+    UDestroyMesh(gPlanetMesh);
+    if (gFlatCulling)
+    {
+        gStaticGeometry.PrintCullStats();
+        gPlanetSpheres.PrintStats("planets");
+    }
+    else
+        gSceneBvh.PrintStats();
+    if (gUseOcclusion)
+        gOcclusion.PrintStats();
+    gOcclusion.Destroy();
+    gStaticGeometry.Destroy();
+    gMeshHeap.PrintStats();
+    gMeshHeap.Destroy();
 
     // Release texture
-    UDestroyTexture(gWalls);
-    UDestroyTexture(gPlane);
-    UDestroyTexture(gFloor);
+    gSceneTextures.Destroy();
+    if (gPlanetVT.IsOpen())
+        gPlanetVT.PrintStats();
+    gPlanetVT.Close();
+
+    gRenderQueue.PrintStats();
+    if (gUseMeshlets)
+        gPlanetMeshlets.PrintStats();
+    URenderState().PrintStats();
 
     // Release shader program
-    UDestroyShaderProgram(gProgramId);
-    UDestroyShaderProgram(gLampProgramId);
+    gShaders.Stop();
+    gSurfaces.Destroy();
+    gPlanetProgram.Destroy();
+    gPlanetFeedbackProgram.Destroy();
+    gHizProgram.Destroy();
+    gOcclusionProgram.Destroy();
+    gCameraBuffer.Destroy();
+    gRenderQueue.Destroy();
 
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
@@ -451,7 +783,10 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
     case GLFW_MOUSE_BUTTON_LEFT:
     {
         if (action == GLFW_PRESS)
+        {
             cout << "Left mouse button pressed" << endl;
+            pickCrosshair();
+        }
         else
             cout << "Left mouse button released" << endl;
     }
@@ -499,96 +834,146 @@ void URender()
     }
     */
     
-    // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    gProfile.BeginFrame();
 
-    // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Waits only if the GPU is still reading the model matrices of three frames ago
+    gRenderQueue.BeginFrame();
 
-    // 1. Scales the object by 2
-    glm::mat4 scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-    // 2. Rotates shape by 0 degrees in the x axis
-    glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    // 3. Place object at the origin
-    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = translation * rotation * scale;
+    // Enable z-depth
+    URenderState().Enable(GL_DEPTH_TEST);
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
 
     // Creates a perspective projection
-    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, FAR_PLANE);
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // Shared by every program through the Camera block
+    gCameraBuffer.Update(view, projection, gCamera.Position, (float)glfwGetTime());
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    glm::mat4 planetModel = planetModelOf(0);
 
+    // Everything outside the view volume is skipped, by walking the scene's
+    // BVH or, with --flat-cull, by testing every sphere 8 at a time
+    Frustum frustum = UExtractFrustum(projection * view);
+    Aabb planetBox = UTransformBox(gPlanetMesh.bounds, planetModel);
+    if (gUseOcclusion)
+        gOcclusion.SetBox(gFirstPlanetObject, planetBox);
+    const unsigned char* planetsVisible;
+    if (gFlatCulling)
+    {
+        glm::vec3 planetCenter;
+        float planetRadius;
+        UTransformSphere(gPlanetMesh.bounds, planetModel, planetCenter, planetRadius);
+        gPlanetSpheres.Set(0, planetCenter, planetRadius);
+        gPlanetSpheres.Cull(frustum, gPlanetVisible);
+        gStaticGeometry.Cull(frustum);
+        planetsVisible = gPlanetVisible.data();
+    }
+    else
+    {
+        // The planet may move; only the nodes above it refit
+        gSceneBvh.Move((int)gFirstPlanetObject, planetBox);
+        gSceneBvh.Cull(frustum, gSceneVisible);
+        gStaticGeometry.SetVisible(gSceneVisible.data());
+        planetsVisible = gSceneVisible.data() + gFirstPlanetObject;
+    }
+    bool planetVisible = planetsVisible[0] != 0;
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao);
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gWalls);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
+    // Once per frame, every planet pass draws the same meshlets
+    if (gPlanetMesh.meshlets && planetVisible)
+        gPlanetMeshlets.Cull(planetModel, gCamera.Position);
 
+    // PLANET FEEDBACK: record which virtual texture pages are visible
+    //----------------
+    if (gPlanetVT.IsOpen() && planetVisible)
+    {
+        ProfileScope section(gProfile, "feedback");
+        gPlanetVT.Update();
+        gPlanetVT.BeginFeedback();
+        gPlanetFeedbackProgram.Use();
+        gPlanetVT.Bind(gPlanetFeedbackProgram, 1, 2, gPlanetVT.FeedbackLodBias());
+        gRenderQueue.Begin(gCamera.Position, FAR_PLANE);
+        gRenderQueue.Submit(meshDraw(gPlanetMesh, gPlanetFeedbackProgram, planetModel));
+        gRenderQueue.Execute();
+        gPlanetVT.EndFeedback();
+    }
 
-    //activate, bind, draw plane mesh & texture
-    glBindVertexArray(gPlaneMesh.vao);
-    glUseProgram(gProgramId);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gPlane);
-    glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
+    gProfile.BeginSection("scene");
 
-    //activate, bind, draw floor mesh & texture
-    glBindVertexArray(gFloorMesh.vao);
-    glUseProgram(gProgramId);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gFloor);
-    glDrawArrays(GL_TRIANGLES, 0, gFloorMesh.nVertices);
+    // Clear the frame and z buffers
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    
-     // LAMP: draw bed lamp
+    // STATIC SCENE: walls, plane, floor and lamp in one indirect draw
     //----------------
+    // Distant meshes drop to coarser levels while their error stays under a pixel
+    float projectionScale = WINDOW_HEIGHT / (2.0f * tan(glm::radians(gCamera.Zoom) * 0.5f));
+    gStaticGeometry.SelectLods(gCamera.Position, projectionScale);
+
+    const ShaderProgram& staticProgram = *gSurfaces.Find(gStaticFeatures);
+    staticProgram.Use();
+    gSceneTextures.Bind(staticProgram, 0);
+    setLight(staticProgram);
+    if (gDrawStaticDirect)
+        gStaticGeometry.DrawDirect();
+    else if (gUseOcclusion)
+    {
+        // Phase 1 draws what was visible last frame, its depth builds the
+        // pyramid, and phase 2 draws what it shows that phase 1 missed
+        GLuint commands = gOcclusion.Cull(gOcclusionProgram, 1);
+        staticProgram.Use();
+        gStaticGeometry.Draw(commands);
+
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        gOcclusion.BuildPyramid(gHizProgram, framebufferWidth, framebufferHeight);
+        commands = gOcclusion.Cull(gOcclusionProgram, 2);
+        staticProgram.Use();
+        gStaticGeometry.Draw(commands);
+    }
+    else
+        gStaticGeometry.Draw();
 
-    // Activate the light VAO (used by lamp)
-    glBindVertexArray(gLightMesh.vao);
-    glUseProgram(gLampProgramId);
-    //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glDrawArrays(GL_TRIANGLES, 0, gLightMesh.nVertices);
+    // Remaining draws are queued with their state and sorted before execution
+    gRenderQueue.Begin(gCamera.Position, FAR_PLANE);
 
     //draw sphere1
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gPlanet1);
-    glBindVertexArray(gProgramId);
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-    S.draw();
+    if (planetVisible && gPlanetVT.IsOpen())
+    {
+        gPlanetProgram.Use();
+        gPlanetVT.Bind(gPlanetProgram, 1, 2);
+        gRenderQueue.Submit(occludable(meshDraw(gPlanetMesh, gPlanetProgram, planetModel), gFirstPlanetObject));
+    }
+    else if (planetVisible)
+    {
+        if (const ShaderProgram* planetProgram = useSurface(gPlanetFeatures))
+            gRenderQueue.Submit(occludable(meshDraw(gPlanetMesh, *planetProgram, planetModel, gPlanet1), gFirstPlanetObject));
+    }
+
+    // The other planets draw whole, their meshlets are culled for the first one only
+    const ShaderProgram* extraProgram = gExtraPlanets.empty() ? nullptr : useSurface(gExtraPlanetFeatures);
+    for (size_t i = 0; extraProgram && i < gExtraPlanets.size(); ++i)
+    {
+        if (!planetsVisible[i + 1])
+            continue;
+        DrawItem item = occludable(meshDraw(gPlanetMesh, *extraProgram, gExtraPlanets[i], gPlanet1), gFirstPlanetObject + i + 1);
+        item.meshlets = nullptr;
+        gRenderQueue.Submit(item);
+    }
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    gRenderQueue.Execute();
+    gRenderQueue.EndFrame();
+
+    // The planet's VAO stays bound, the feedback pass starts with it next frame
+    gProfile.EndSection();
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    gProfile.BeginSection("swap");
     glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    gProfile.EndSection();
+
+    gProfile.EndFrame();
 }
 
 
@@ -739,28 +1124,8 @@ void UCreateMesh(GLMesh& mesh)
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerUV + floatsPerNorm));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create VBO
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerNorm);
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-
-    glVertexAttribPointer(1, floatsPerNorm, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerUV)));
-    glEnableVertexAttribArray(1);
-
+    // Positions, texture coordinates, normals
+    addStaticMesh(mesh, "room", verts, mesh.nVertices, PoolVertexLayout{ 8, 0, 5, 3 });
 }
 
 
@@ -783,26 +1148,8 @@ void UCreatePlaneMesh(GLMesh& mesh)
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerUV)); //sets a variable for the number of verices
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create VBO
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV);
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    
-
+    // Positions and texture coordinates
+    addStaticMesh(mesh, "plane", verts, mesh.nVertices, PoolVertexLayout{ 5, 0, -1, 3 });
 }
 
 // Implements the UCreateMesh function
@@ -861,25 +1208,8 @@ void UCreateFloorMesh(GLMesh& mesh)
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create VBO
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV);
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-
+    // Positions and texture coordinates
+    addStaticMesh(mesh, "floor", verts, mesh.nVertices, PoolVertexLayout{ 5, 0, -1, 3 });
 }
 
 // Implements the UCreateLightMesh function
@@ -944,150 +1274,51 @@ void UCreateLightMesh(GLMesh& mesh)
 
     mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    // Positions, normals, texture coordinates
+    addStaticMesh(mesh, "lamp", verts, mesh.nVertices, PoolVertexLayout{ 8, 0, 3, 6 });
 }
 
 
 
 
-void UDestroyMesh(GLMesh& mesh)
-{
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(1, &mesh.vbo);
-}
-
-
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+// Implements the UCreateSphereMesh function: uploads the sphere's interleaved
+// V/N/T vertices with its indices into gMeshHeap
+void UCreateSphereMesh(GLMesh& mesh, const Sphere& sphere)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
-    {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-        return true;
-    }
-
-    // Error loading the image
-    return false;
-}
-
-
-void UDestroyTexture(GLuint textureId)
-{
-    glGenTextures(1, &textureId);
-}
-
-
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
-{
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
-
-    // Create a Shader program object.
-    programId = glCreateProgram();
-
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
-
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-
-        return false;
-    }
-
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+    const GLuint floatsPerElement = floatsPerVertex + floatsPerNormal + floatsPerUV;
+    static_assert(MeshVertexLayout::stride == floatsPerElement * sizeof(GLfloat), "Sphere vertices are stored in MeshVertexLayout");
 
-        return false;
-    }
+    // Sphere texture coordinates start at the top of the image, ours are flipped at load
+    std::vector<GLfloat> verts(sphere.getInterleavedVertices(), sphere.getInterleavedVertices() + sphere.getInterleavedVertexCount() * floatsPerElement);
+    for (size_t i = floatsPerVertex + floatsPerNormal + 1; i < verts.size(); i += floatsPerElement)
+        verts[i] = 1.0f - verts[i];
 
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
+    mesh.nVertices = sphere.getInterleavedVertexCount();
+    mesh.nIndices = sphere.getIndexCount();
 
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
+    // Meshlet order replaces the sphere's own, the heap holds the reordered indices
+    const GLuint* indices = sphere.getIndices();
+    if (gUseMeshlets)
     {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-
-        return false;
+        gPlanetMeshlets.Build(verts.data(), mesh.nVertices, indices, mesh.nIndices);
+        indices = gPlanetMeshlets.Indices().data();
+        mesh.meshlets = &gPlanetMeshlets;
+        cout << "INFO: Planet split into " << gPlanetMeshlets.Meshlets().size() << " meshlets" << endl;
     }
 
-    glUseProgram(programId);    // Uses the shader program
-
-    return true;
+    mesh.bounds = UComputeBounds(verts.data(), mesh.nVertices, floatsPerElement);
+    if (gMeshHeap.Allocate(verts.data(), mesh.nVertices, indices, mesh.nIndices, mesh.allocation))
+        mesh.vao = gMeshHeap.VertexArray();
 }
 
 
-void UDestroyShaderProgram(GLuint programId)
+void UDestroyMesh(GLMesh& mesh)
 {
-    glDeleteProgram(programId);
-}
\ No newline at end of file
+    // Static meshes live in gStaticGeometry and have no heap ranges
+    gMeshHeap.Free(mesh.allocation);
+    mesh.vao = 0;
+    mesh.meshlets = nullptr;
+}
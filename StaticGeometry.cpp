@@ -0,0 +1,477 @@
+// StaticGeometry.cpp
+// Static geometry pool drawn with multi-draw indirect, see StaticGeometry.h
+
+#include <algorithm>
+#include <iostream>         // cout, cerr
+
+#include "MeshWeld.h"
+#include "Parallel.h"
+#include "RenderState.h"
+#include "StaticGeometry.h"
+#include "VertexLayout.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const int FLOATS_PER_VERTEX = 8;
+    static_assert(MeshVertexLayout::stride == FLOATS_PER_VERTEX * sizeof(float), "Pool vertices are stored in MeshVertexLayout");
+
+    // Per-instance index into the draw data, selected by each command's baseInstance
+    typedef VertexLayout<VertexAttribute<STATIC_DRAW_ID_LOCATION, GLuint, 1>> DrawIdLayout;
+
+    // Normals for a mesh added without them: every vertex sums the area
+    // weighted normals of the triangles that use it. Unindexed triangles
+    // (indices null) own their corners and come out flat, indexed meshes
+    // smooth across shared vertices.
+    void generateNormals(float* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+    {
+        size_t cornerCount = indices ? indexCount : vertexCount;
+        for (size_t i = 0; i + 2 < cornerCount; i += 3)
+        {
+            size_t corners[3] = { i, i + 1, i + 2 };
+            if (indices)
+                for (size_t& corner : corners)
+                    corner = indices[corner];
+            if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount)
+                continue;
+
+            const float* a = vertices + corners[0] * FLOATS_PER_VERTEX;
+            const float* b = vertices + corners[1] * FLOATS_PER_VERTEX;
+            const float* c = vertices + corners[2] * FLOATS_PER_VERTEX;
+            glm::vec3 normal = glm::cross(glm::vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]),
+                                          glm::vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+            for (size_t corner : corners)
+                for (int k = 0; k < 3; ++k)
+                    vertices[corner * FLOATS_PER_VERTEX + 3 + k] += normal[k];
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            float* normal = vertices + v * FLOATS_PER_VERTEX + 3;
+            float length = glm::length(glm::vec3(normal[0], normal[1], normal[2]));
+            if (length > 0.0f)
+                for (int k = 0; k < 3; ++k)
+                    normal[k] /= length;
+        }
+    }
+}
+
+
+int StaticGeometryPool::AddMesh(const float* source, size_t vertexCount, const PoolVertexLayout& layout,
+                                const GLuint* sourceIndices, size_t indexCount)
+{
+    if (vertexArray)
+    {
+        cout << "Static geometry is already built" << endl;
+        return -1;
+    }
+
+    // Normals come from the positions when the source has none; only a mesh
+    // without either leaves the pool to derive them per pixel
+    hasNormals = hasNormals && (layout.normal >= 0 || layout.position >= 0);
+
+    MeshRange range;
+    LodRange full;
+    full.firstIndex = (GLuint)indices.size();
+    full.error = 0.0f;
+    range.baseVertex = (GLint)(vertices.size() / FLOATS_PER_VERTEX);
+
+    // Unindexed meshes are welded, so they land in the same pool layout
+    vector<float>& converted = sourceIndices ? vertices : scratch;
+    if (layout.stride == FLOATS_PER_VERTEX && layout.position == 0 && layout.normal == 3 && layout.uv == 6)
+    {
+        // Already in the pool's layout, one straight copy
+        converted.insert(converted.end(), source, source + vertexCount * FLOATS_PER_VERTEX);
+    }
+    else
+    {
+        converted.reserve(converted.size() + vertexCount * FLOATS_PER_VERTEX);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            const float* vertex = source + v * layout.stride;
+            for (int i = 0; i < 3; ++i)
+                converted.push_back(layout.position >= 0 ? vertex[layout.position + i] : 0.0f);
+            for (int i = 0; i < 3; ++i)
+                converted.push_back(layout.normal >= 0 ? vertex[layout.normal + i] : 0.0f);
+            for (int i = 0; i < 2; ++i)
+                converted.push_back(layout.uv >= 0 ? vertex[layout.uv + i] : 0.0f);
+        }
+        // Before welding, so triangles of an unindexed mesh keep their own corners
+        if (layout.normal < 0 && layout.position >= 0 && vertexCount)
+            generateNormals(&converted[converted.size() - vertexCount * FLOATS_PER_VERTEX], vertexCount, sourceIndices, indexCount);
+    }
+
+    // Indices stay relative to the mesh, baseVertex offsets them
+    if (sourceIndices)
+        indices.insert(indices.end(), sourceIndices, sourceIndices + indexCount);
+    else
+    {
+        size_t unique = UWeldVertices(scratch.data(), vertexCount, FLOATS_PER_VERTEX, vertices, indices);
+        scratch.clear();
+        weldedVertices += vertexCount;
+        weldedDuplicates += vertexCount - unique;
+    }
+    full.indexCount = (GLuint)(indices.size() - full.firstIndex);
+    range.vertexCount = (GLuint)(vertices.size() / FLOATS_PER_VERTEX - range.baseVertex);
+
+    // For choosing levels of detail and frustum culling
+    range.bounds = UComputeBounds(vertices.data() + size_t(range.baseVertex) * FLOATS_PER_VERTEX, range.vertexCount, FLOATS_PER_VERTEX);
+
+    range.firstLod = (int)lods.size();
+    range.lodCount = 1;
+    lods.push_back(full);
+    meshes.push_back(range);
+    return (int)meshes.size() - 1;
+}
+
+
+void StaticGeometryPool::BuildLods(int maxLods)
+{
+    if (vertexArray)
+        return;
+
+    // Meshes simplify independently, each on whichever thread takes it
+    vector<vector<GLuint>> chainIndices(meshes.size());
+    vector<vector<MeshLod>> chains(meshes.size());
+    UParallelFor(meshes.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t m = begin; m < end; ++m)
+        {
+            const MeshRange& range = meshes[m];
+            const LodRange& full = lods[range.firstLod];
+            if (full.indexCount == 0)
+                continue;
+            UBuildLodChain(&vertices[size_t(range.baseVertex) * FLOATS_PER_VERTEX], range.vertexCount,
+                           &indices[full.firstIndex], full.indexCount, maxLods, chainIndices[m], chains[m]);
+        }
+    });
+
+    // Full detail stays where AddMesh put it, coarser levels follow every mesh
+    vector<LodRange> chained;
+    for (size_t m = 0; m < meshes.size(); ++m)
+    {
+        MeshRange& range = meshes[m];
+        LodRange full = lods[range.firstLod];
+        range.firstLod = (int)chained.size();
+        range.lodCount = 1;
+        chained.push_back(full);
+        for (size_t level = 1; level < chains[m].size(); ++level)
+        {
+            const MeshLod& lod = chains[m][level];
+            ++range.lodCount;
+            chained.push_back(LodRange{ (GLuint)indices.size(), (GLuint)lod.indexCount, lod.error });
+            indices.insert(indices.end(), chainIndices[m].begin() + lod.firstIndex,
+                           chainIndices[m].begin() + lod.firstIndex + lod.indexCount);
+        }
+    }
+    lods.swap(chained);
+}
+
+
+int StaticGeometryPool::AddDraw(int mesh, const glm::mat4& model, int layer)
+{
+    if (mesh < 0 || mesh >= (int)meshes.size() || vertexArray)
+        return -1;
+
+    DrawEntry draw;
+    draw.mesh = mesh;
+    draw.model = model;
+    draw.layer = layer;
+    draws.push_back(draw);
+    return (int)draws.size() - 1;
+}
+
+
+bool StaticGeometryPool::Build(const TextureArray& textures)
+{
+    static_assert(sizeof(DrawData) == 80, "DrawData must match the std430 layout of the shader's DrawData");
+    if (draws.empty() || vertexArray)
+        return false;
+
+    commands.resize(draws.size());
+    vector<DrawData> drawData(draws.size());
+    vector<GLuint> drawIds(draws.size());
+    for (size_t i = 0; i < draws.size(); ++i)
+    {
+        DrawEntry& draw = draws[i];
+        const MeshRange& range = meshes[draw.mesh];
+        const LodRange& full = lods[range.firstLod];
+        commands[i].count = full.indexCount;
+        commands[i].instanceCount = 1;
+        commands[i].firstIndex = full.firstIndex;
+        commands[i].baseVertex = range.baseVertex;
+        commands[i].baseInstance = (GLuint)i;    // selects drawIds[i] and so drawData[i]
+
+        // Layers the array does not have draw untextured
+        int layer = draw.layer < textures.LayerCount() ? draw.layer : -1;
+        glm::vec2 uvScale = layer >= 0 ? textures.UvScale(layer) : glm::vec2(1.0f);
+        drawData[i].model = draw.model;
+        drawData[i].material = glm::vec4(uvScale.x, uvScale.y, (float)layer, 0.0f);
+        drawIds[i] = (GLuint)i;
+
+        glm::vec3 axes(glm::length(glm::vec3(draw.model[0])), glm::length(glm::vec3(draw.model[1])), glm::length(glm::vec3(draw.model[2])));
+        draw.scale = max(axes.x, max(axes.y, axes.z));
+        UTransformSphere(range.bounds, draw.model, draw.center, draw.radius);
+        drawSpheres.Add(draw.center, draw.radius);
+        draw.lod = 0;
+        fullTriangles += full.indexCount / 3;
+    }
+    drawnTriangles = fullTriangles;
+
+    glGenVertexArrays(1, &vertexArray);
+    URenderState().BindVertexArray(vertexArray);
+
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    MeshVertexLayout::Apply(VERTEX_BUFFER_BINDING);
+    MeshVertexLayout::Bind(VERTEX_BUFFER_BINDING, vertexBuffer);
+
+    glGenBuffers(1, &drawIdBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+    DrawIdLayout::Apply(DRAW_INDEX_BUFFER_BINDING, 1);
+    DrawIdLayout::Bind(DRAW_INDEX_BUFFER_BINDING, drawIdBuffer);
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &drawBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, drawData.size() * sizeof(DrawData), drawData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &indirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(IndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    uploadedBytes = vertices.size() * sizeof(float) + indices.size() * sizeof(GLuint) +
+                    drawIds.size() * sizeof(GLuint) + drawData.size() * sizeof(DrawData) +
+                    commands.size() * sizeof(IndirectCommand);
+
+    // Picking only needs positions and the full detail triangles, which come
+    // before every coarser level
+    pickPositions.resize(vertices.size() / FLOATS_PER_VERTEX);
+    for (size_t v = 0; v < pickPositions.size(); ++v)
+        pickPositions[v] = glm::vec3(vertices[v * FLOATS_PER_VERTEX], vertices[v * FLOATS_PER_VERTEX + 1], vertices[v * FLOATS_PER_VERTEX + 2]);
+    size_t fullIndexEnd = 0;
+    for (const MeshRange& range : meshes)
+        fullIndexEnd = max(fullIndexEnd, size_t(lods[range.firstLod].firstIndex + lods[range.firstLod].indexCount));
+    pickIndices.assign(indices.begin(), indices.begin() + fullIndexEnd);
+
+    // The GPU has its own copy now
+    vector<float>().swap(vertices);
+    vector<GLuint>().swap(indices);
+    vector<float>().swap(scratch);
+    return true;
+}
+
+
+void StaticGeometryPool::Destroy()
+{
+    if (vertexArray)
+    {
+        URenderState().ForgetVertexArray(vertexArray);
+        glDeleteVertexArrays(1, &vertexArray);
+        GLuint buffers[] = { vertexBuffer, indexBuffer, drawIdBuffer, drawBuffer, indirectBuffer };
+        glDeleteBuffers(5, buffers);
+    }
+    vertexArray = vertexBuffer = indexBuffer = drawIdBuffer = drawBuffer = indirectBuffer = 0;
+    vertices.clear();
+    indices.clear();
+    pickPositions.clear();
+    pickIndices.clear();
+    meshes.clear();
+    lods.clear();
+    draws.clear();
+    commands.clear();
+    drawSpheres.Clear();
+    drawVisible.clear();
+    vector<float>().swap(scratch);
+    hasNormals = true;
+    weldedVertices = weldedDuplicates = 0;
+    drawnTriangles = fullTriangles = 0;
+    uploadedBytes = 0;
+}
+
+
+void StaticGeometryPool::SelectLods(const glm::vec3& camera, float projectionScale)
+{
+    if (!vertexArray)
+        return;
+
+    // Only the span of commands that changed is uploaded
+    size_t firstChanged = commands.size(), lastChanged = 0;
+    drawnTriangles = 0;
+    for (size_t i = 0; i < draws.size(); ++i)
+    {
+        DrawEntry& draw = draws[i];
+        const MeshRange& range = meshes[draw.mesh];
+
+        // Distance to the nearest point of the bounding sphere, full detail inside it
+        float distance = glm::length(draw.center - camera) - draw.radius;
+        int lod = 0;
+        if (distance > 0.0f)
+        {
+            float maxError = STATIC_LOD_PIXEL_ERROR * distance / (projectionScale * draw.scale);
+            while (lod + 1 < range.lodCount && lods[range.firstLod + lod + 1].error <= maxError)
+                ++lod;
+        }
+
+        const LodRange& level = lods[range.firstLod + lod];
+        drawnTriangles += commands[i].instanceCount * level.indexCount / 3;
+        if (lod == draw.lod)
+            continue;
+        draw.lod = lod;
+        commands[i].count = level.indexCount;
+        commands[i].firstIndex = level.firstIndex;
+        firstChanged = min(firstChanged, i);
+        lastChanged = i;
+    }
+
+    UploadCommands(firstChanged, lastChanged);
+}
+
+
+void StaticGeometryPool::Cull(const Frustum& frustum)
+{
+    if (!vertexArray)
+        return;
+
+    drawSpheres.Cull(frustum, drawVisible);
+    SetVisible(drawVisible.data());
+}
+
+
+void StaticGeometryPool::SetVisible(const unsigned char* visible)
+{
+    if (!vertexArray)
+        return;
+
+    // Culled draws stay in the buffer with no instances
+    size_t firstChanged = commands.size(), lastChanged = 0;
+    for (size_t i = 0; i < commands.size(); ++i)
+    {
+        GLuint instances = visible[i] ? 1 : 0;
+        if (commands[i].instanceCount == instances)
+            continue;
+        commands[i].instanceCount = instances;
+        firstChanged = min(firstChanged, i);
+        lastChanged = i;
+    }
+    UploadCommands(firstChanged, lastChanged);
+}
+
+
+Aabb StaticGeometryPool::DrawBox(size_t draw) const
+{
+    return UTransformBox(meshes[draws[draw].mesh].bounds, draws[draw].model);
+}
+
+
+bool StaticGeometryPool::Raycast(size_t draw, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                                 float& distance) const
+{
+    if (draw >= draws.size() || pickPositions.empty())
+        return false;
+
+    // The ray moves into mesh space unnormalized, so distances stay in world units
+    const DrawEntry& entry = draws[draw];
+    glm::mat4 toMesh = glm::inverse(entry.model);
+    glm::vec3 meshOrigin = glm::vec3(toMesh * glm::vec4(origin, 1.0f));
+    glm::vec3 meshDirection = glm::vec3(toMesh * glm::vec4(direction, 0.0f));
+
+    const MeshRange& range = meshes[entry.mesh];
+    const LodRange& full = lods[range.firstLod];
+    const glm::vec3* positions = &pickPositions[range.baseVertex];
+    float nearest = maxDistance;
+    bool hit = false;
+    for (GLuint i = full.firstIndex; i + 2 < full.firstIndex + full.indexCount; i += 3)
+    {
+        // Moller-Trumbore, without culling either side
+        glm::vec3 a = positions[pickIndices[i]];
+        glm::vec3 edge1 = positions[pickIndices[i + 1]] - a;
+        glm::vec3 edge2 = positions[pickIndices[i + 2]] - a;
+        glm::vec3 p = glm::cross(meshDirection, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (determinant == 0.0f)
+            continue;
+        float inverse = 1.0f / determinant;
+        glm::vec3 toOrigin = meshOrigin - a;
+        float u = glm::dot(toOrigin, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            continue;
+        glm::vec3 q = glm::cross(toOrigin, edge1);
+        float v = glm::dot(meshDirection, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            continue;
+        float t = glm::dot(edge2, q) * inverse;
+        if (t >= 0.0f && t <= nearest)
+        {
+            nearest = t;
+            hit = true;
+        }
+    }
+    if (hit)
+        distance = nearest;
+    return hit;
+}
+
+
+void StaticGeometryPool::UploadCommands(size_t first, size_t last)
+{
+    if (first > last)
+        return;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, first * sizeof(IndirectCommand),
+                    (last - first + 1) * sizeof(IndirectCommand), &commands[first]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+void StaticGeometryPool::Draw(GLuint commandBuffer) const
+{
+    if (!vertexArray)
+        return;
+
+    URenderState().BindVertexArray(vertexArray);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATIC_DRAW_BUFFER_BINDING, drawBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer ? commandBuffer : indirectBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)draws.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+
+void StaticGeometryPool::DrawDirect() const
+{
+    if (!vertexArray)
+        return;
+
+    URenderState().BindVertexArray(vertexArray);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATIC_DRAW_BUFFER_BINDING, drawBuffer);
+    for (const IndirectCommand& command : commands)
+    {
+        if (command.instanceCount == 0)
+            continue;
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                                      (void*)(sizeof(GLuint) * command.firstIndex), 1,
+                                                      command.baseVertex, command.baseInstance);
+    }
+}
+
+
+void StaticGeometryPool::PrintStats() const
+{
+    cout << "INFO: Static geometry: " << meshes.size() << " meshes, " << draws.size()
+         << " draws in one indirect call, " << uploadedBytes / 1024 << " KB" << endl;
+    if (weldedVertices)
+        cout << "INFO:   welded unindexed meshes: " << weldedDuplicates << " of " << weldedVertices
+             << " vertices were duplicates" << endl;
+    if (lods.size() > meshes.size())
+        cout << "INFO:   " << lods.size() << " levels of detail, " << drawnTriangles << " of " << fullTriangles
+             << " triangles drawn at the last selection" << endl;
+}
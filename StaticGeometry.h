@@ -0,0 +1,171 @@
+// StaticGeometry.h
+// Pool for geometry that never changes after startup. Every mesh shares one
+// vertex buffer and one index buffer, per-draw transforms and texture
+// layers live in a shader storage buffer, and the whole pool is drawn with
+// a single glMultiDrawElementsIndirect.
+//
+// Vertices are stored as position, normal, texture coordinate (8 floats).
+// The draw index reaches the shader through an instanced attribute and
+// each command's baseInstance, which works on GL 4.4 without
+// ARB_shader_draw_parameters.
+//
+// Meshes can carry simplified levels of detail. Each frame SelectLods picks
+// per draw the coarsest level whose error stays under a pixel on screen and
+// rewrites the indirect commands that changed. Cull zeroes the instance
+// count of draws outside the view frustum the same way.
+
+#ifndef STATIC_GEOMETRY_H
+#define STATIC_GEOMETRY_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Culling.h"
+#include "MeshSimplify.h"
+#include "TextureArray.h"
+
+// Shader storage binding point of the per-draw data
+const GLuint STATIC_DRAW_BUFFER_BINDING = 1;
+// Vertex attribute carrying the draw index (uint, one per instance)
+const GLuint STATIC_DRAW_ID_LOCATION = 3;
+// Largest screen space error, in pixels, a level of detail may show
+const float STATIC_LOD_PIXEL_ERROR = 1.0f;
+
+// Where the pool finds each attribute in source vertices, in floats. Missing
+// normals (-1) are generated from the triangles, other missing attributes
+// are zero filled.
+struct PoolVertexLayout
+{
+    int stride;
+    int position;
+    int normal;
+    int uv;
+};
+
+class StaticGeometryPool
+{
+public:
+    StaticGeometryPool() {}
+
+    // Appends a mesh and returns its id. Meshes without indices are welded:
+    // duplicate vertices merge and indices are generated.
+    int AddMesh(const float* vertices, size_t vertexCount, const PoolVertexLayout& layout,
+                const GLuint* indices = nullptr, size_t indexCount = 0);
+    // Adds one draw of a mesh; layer selects the texture array layer, -1 draws untextured (white)
+    int AddDraw(int mesh, const glm::mat4& model, int layer);
+    // Simplifies every mesh into a chain of up to maxLods levels, on all
+    // hardware threads. Call after the last AddMesh and before Build.
+    void BuildLods(int maxLods = MESH_MAX_LODS);
+
+    // Uploads everything. Texture coordinates are scaled for the layers of textures.
+    bool Build(const TextureArray& textures);
+    void Destroy();
+
+    // Chooses each draw's level of detail for a camera at camera.
+    // projectionScale converts an error at distance 1 into pixels: the
+    // viewport height over 2 tan(vertical fov / 2).
+    void SelectLods(const glm::vec3& camera, float projectionScale);
+    // Skips the draws whose bounding spheres are outside the frustum
+    void Cull(const Frustum& frustum);
+    // Skips the draws whose visible[draw] is 0, for culling done elsewhere
+    void SetVisible(const unsigned char* visible);
+    // World space box of a draw, valid after Build
+    Aabb DrawBox(size_t draw) const;
+    // Distance along a world space ray (direction normalized) to the nearest
+    // full detail triangle of a draw, either side, within maxDistance; false
+    // when it misses. For picking, the pool keeps positions on the CPU.
+    bool Raycast(size_t draw, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+
+    // Draws every draw with one indirect call, from commandBuffer when given:
+    // a buffer laid out like CommandBuffer() written elsewhere (Occlusion.h)
+    void Draw(GLuint commandBuffer = 0) const;
+    // Same draws with one call each, for comparing submission cost
+    void DrawDirect() const;
+
+    // False when some mesh had neither normals nor positions to generate them from
+    bool HasNormals() const { return hasNormals; }
+    size_t MeshCount() const { return meshes.size(); }
+    size_t DrawCount() const { return draws.size(); }
+    // The indirect commands, one per draw in AddDraw order, valid after Build
+    GLuint CommandBuffer() const { return indirectBuffer; }
+    void PrintStats() const;
+    void PrintCullStats() const { drawSpheres.PrintStats("static draws"); }
+
+private:
+    struct MeshRange
+    {
+        GLint baseVertex;
+        GLuint vertexCount;
+        int firstLod;           // into lods, full detail first
+        int lodCount;
+        Bounds bounds;
+    };
+
+    struct LodRange
+    {
+        GLuint firstIndex;
+        GLuint indexCount;
+        float error;            // mesh units
+    };
+
+    struct DrawEntry
+    {
+        int mesh;
+        glm::mat4 model;
+        int layer;
+        glm::vec3 center;       // world space bounding sphere, set by Build
+        float radius;
+        float scale;            // largest axis scale of model
+        int lod;                // selected level
+    };
+
+    // Matches DrawElementsIndirectCommand
+    struct IndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // std430 layout of the shader's DrawData
+    struct DrawData
+    {
+        glm::mat4 model;
+        glm::vec4 material;     // uv scale, layer, unused
+    };
+
+    std::vector<float> vertices;
+    std::vector<GLuint> indices;
+    std::vector<float> scratch;         // unindexed mesh before welding
+    std::vector<glm::vec3> pickPositions;   // kept after Build for Raycast
+    std::vector<GLuint> pickIndices;        // full detail levels only
+    std::vector<MeshRange> meshes;
+    std::vector<LodRange> lods;
+    std::vector<DrawEntry> draws;
+    std::vector<IndirectCommand> commands;  // what the indirect buffer holds
+    SphereSet drawSpheres;                  // world space bounds of each draw, for Cull
+    std::vector<unsigned char> drawVisible;
+
+    GLuint vertexArray = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint drawIdBuffer = 0;
+    GLuint drawBuffer = 0;
+    GLuint indirectBuffer = 0;
+    size_t uploadedBytes = 0;
+    bool hasNormals = true;
+    size_t weldedVertices = 0;
+    size_t weldedDuplicates = 0;
+    size_t drawnTriangles = 0;          // with the selected levels
+    size_t fullTriangles = 0;           // at full detail
+
+    // Uploads commands[first..last] when first <= last
+    void UploadCommands(size_t first, size_t last);
+};
+
+#endif
@@ -0,0 +1,225 @@
+// Texture.cpp
+// Texture loading and the texture manager, see Texture.h
+
+#include <iostream>         // cout, cerr
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"    // Image loading Utility functions
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "Mipmap.h"       // CPU mip chain builder
+#include "RenderState.h"
+#include "Texture.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Drivers store RGB8 as RGBA8, so every texel is counted as 4 bytes
+    size_t residentSize(const MipChain& chain)
+    {
+        size_t bytes = 0;
+        for (const MipLevel& level : chain.levels)
+            bytes += size_t(level.width) * level.height * 4;
+        return bytes;
+    }
+}
+
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
+void flipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+    for (int j = 0; j < height / 2; ++j)
+    {
+        int index1 = j * width * channels;
+        int index2 = (height - 1 - j) * width * channels;
+
+        for (int i = width * channels; i > 0; --i)
+        {
+            unsigned char tmp = image[index1];
+            image[index1] = image[index2];
+            image[index2] = tmp;
+            ++index1;
+            ++index2;
+        }
+    }
+}
+
+
+/*Generate and load the texture*/
+bool UCreateTexture(const char* filename, GLuint& textureId)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    size_t residentBytes;
+    return UCreateTexture(filename, file.Data(), file.Size(), textureId, residentBytes);
+}
+
+
+bool ULoadTextureChain(const char* filename, MipChain& chain)
+{
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    return ULoadTextureChain(filename, file.Data(), file.Size(), chain);
+}
+
+
+bool ULoadTextureChain(const char* filename, const unsigned char* fileData, size_t fileSize, MipChain& chain)
+{
+    // Mip levels are built on the CPU and cached next to the image, so the
+    // decode and filtering only happen when the image changes
+    std::string cacheFilename = std::string(filename) + ".mips";
+    if (ULoadMipChain(cacheFilename.c_str(), filename, chain))
+        return true;
+
+    int width, height, channels;
+    unsigned char* image = stbi_load_from_memory(fileData, (int)fileSize, &width, &height, &channels, 0);
+    if (!image)
+        return false; // Error loading the image
+
+    if (channels != 3 && channels != 4)
+    {
+        cout << "Not implemented to handle image with " << channels << " channels" << endl;
+        stbi_image_free(image);
+        return false;
+    }
+
+    flipImageVertically(image, width, height, channels);
+    bool built = UBuildMipChain(image, width, height, channels, MIP_FILTER_KAISER, chain);
+    stbi_image_free(image);
+    if (!built)
+        return false;
+
+    if (!USaveMipChain(cacheFilename.c_str(), filename, chain))
+        cout << "Could not write mip cache " << cacheFilename << endl;
+
+    return true;
+}
+
+
+bool UCreateTexture(const char* filename, const unsigned char* fileData, size_t fileSize, GLuint& textureId, size_t& residentBytes)
+{
+    MipChain chain;
+    if (!ULoadTextureChain(filename, fileData, fileSize, chain))
+        return false;
+
+    glGenTextures(1, &textureId);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, textureId);
+
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Upload each level instead of glGenerateMipmap
+    bool uploaded = UUploadMipChain(chain);
+
+    if (!uploaded)
+    {
+        UDestroyTexture(textureId);
+        return false;
+    }
+
+    residentBytes = residentSize(chain);
+    return true;
+}
+
+
+void UDestroyTexture(GLuint textureId)
+{
+    URenderState().ForgetTexture(textureId);
+    glDeleteTextures(1, &textureId);
+}
+
+
+GLuint TextureManager::Acquire(const char* filename)
+{
+    // Same path: just another reference
+    auto path = byPath.find(filename);
+    if (path != byPath.end())
+    {
+        ++entries[path->second].refCount;
+        return path->second;
+    }
+
+    // The decoder reads straight from the mapping, no intermediate copy
+    MappedFile file;
+    if (!file.Open(filename))
+        return 0;
+
+    // Different path, same image: alias the existing texture
+    unsigned long long contentHash = UHashBytes(file.Data(), file.Size());
+    auto content = byHash.find(contentHash);
+    if (content != byHash.end())
+    {
+        Entry& entry = entries[content->second];
+        ++entry.refCount;
+        entry.paths.push_back(filename);
+        byPath[filename] = content->second;
+        return content->second;
+    }
+
+    GLuint textureId;
+    size_t bytes;
+    if (!UCreateTexture(filename, file.Data(), file.Size(), textureId, bytes))
+        return 0;
+
+    Entry entry;
+    entry.contentHash = contentHash;
+    entry.refCount = 1;
+    entry.bytes = bytes;
+    entry.paths.push_back(filename);
+    entries[textureId] = entry;
+    byPath[filename] = textureId;
+    byHash[contentHash] = textureId;
+    residentBytes += bytes;
+
+    return textureId;
+}
+
+
+void TextureManager::Release(GLuint textureId)
+{
+    auto found = entries.find(textureId);
+    if (found == entries.end())
+        return;
+
+    Entry& entry = found->second;
+    if (--entry.refCount > 0)
+        return;
+
+    for (const string& path : entry.paths)
+        byPath.erase(path);
+    byHash.erase(entry.contentHash);
+    residentBytes -= entry.bytes;
+    entries.erase(found);
+
+    UDestroyTexture(textureId);
+}
+
+
+void TextureManager::ReleaseAll()
+{
+    for (const auto& entry : entries)
+        UDestroyTexture(entry.first);
+
+    byPath.clear();
+    byHash.clear();
+    entries.clear();
+    residentBytes = 0;
+}
+
+
+void TextureManager::PrintStats() const
+{
+    cout << "INFO: Textures resident: " << entries.size()
+         << " (" << byPath.size() << " paths), "
+         << residentBytes / 1024 << " KB" << endl;
+}
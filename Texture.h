@@ -0,0 +1,63 @@
+// Texture.h
+// Texture loading and a reference counted texture manager that shares
+// GL textures between every user of the same image file or contents.
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Mipmap.h"       // CPU mip chain builder
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
+void flipImageVertically(unsigned char* image, int width, int height, int channels);
+
+// Loads the mip chain of an image file, from its cache when up to date.
+// Files are memory mapped and decoded in place (see MappedFile.h).
+bool ULoadTextureChain(const char* filename, MipChain& chain);
+bool ULoadTextureChain(const char* filename, const unsigned char* fileData, size_t fileSize, MipChain& chain);
+
+// Loads an image file (or its cached mip chain) into a new GL texture.
+// residentBytes receives the estimated GPU memory of all levels.
+bool UCreateTexture(const char* filename, GLuint& textureId);
+bool UCreateTexture(const char* filename, const unsigned char* fileData, size_t fileSize, GLuint& textureId, size_t& residentBytes);
+void UDestroyTexture(GLuint textureId);
+
+
+// Deduplicates textures by path and by content hash, so scene variants
+// that share images upload them once. The GL texture is deleted when the
+// last user releases it.
+class TextureManager
+{
+public:
+    // Returns the texture for filename, loading it on first use (0 on failure)
+    GLuint Acquire(const char* filename);
+    // Drops one reference, deleting the texture with the last one
+    void Release(GLuint textureId);
+    // Deletes every texture regardless of references (context teardown)
+    void ReleaseAll();
+
+    size_t TextureCount() const { return entries.size(); }
+    size_t ResidentBytes() const { return residentBytes; }
+    void PrintStats() const;
+
+private:
+    struct Entry
+    {
+        unsigned long long contentHash;
+        int refCount;
+        size_t bytes;
+        std::vector<std::string> paths;     // every path that resolved to this texture
+    };
+
+    std::unordered_map<std::string, GLuint> byPath;
+    std::unordered_map<unsigned long long, GLuint> byHash;
+    std::unordered_map<GLuint, Entry> entries;
+    size_t residentBytes = 0;
+};
+
+#endif
@@ -0,0 +1,179 @@
+// TextureArray.cpp
+// Scene texture array, see TextureArray.h
+
+#include <algorithm>
+#include <iostream>         // cout, cerr
+
+#include "Hash.h"
+#include "MappedFile.h"
+#include "RenderState.h"
+#include "TextureArray.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Fills a layer level by repeating the image across it. The texels right of and
+    // above the image then continue it as GL_REPEAT would, so bilinear filtering
+    // at the edge of the image's rect still wraps correctly.
+    void tileLevel(const MipLevel& level, int channels, int width, int height, vector<unsigned char>& rgba)
+    {
+        rgba.resize(size_t(width) * height * 4);
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* src = &level.pixels[size_t(y % level.height) * level.width * channels];
+            unsigned char* dst = &rgba[size_t(y) * width * 4];
+            for (int x = 0; x < width; ++x, dst += 4)
+            {
+                const unsigned char* texel = src + (x % level.width) * channels;
+                dst[0] = texel[0];
+                dst[1] = texel[1];
+                dst[2] = texel[2];
+                dst[3] = channels == 4 ? texel[3] : 255;
+            }
+        }
+    }
+}
+
+
+int TextureArray::Add(const char* filename)
+{
+    auto path = byPath.find(filename);
+    if (path != byPath.end())
+        return path->second;
+
+    if (texture)
+    {
+        cout << "Texture array is already built, cannot add " << filename << endl;
+        return -1;
+    }
+
+    MappedFile file;
+    if (!file.Open(filename))
+        return -1;
+
+    unsigned long long contentHash = UHashBytes(file.Data(), file.Size());
+    auto content = byHash.find(contentHash);
+    if (content != byHash.end())
+    {
+        byPath[filename] = content->second;
+        return content->second;
+    }
+
+    Layer layer;
+    layer.filename = filename;
+    if (!ULoadTextureChain(filename, file.Data(), file.Size(), layer.chain))
+        return -1;
+
+    int index = (int)layers.size();
+    layers.push_back(std::move(layer));
+    byPath[filename] = index;
+    byHash[contentHash] = index;
+    return index;
+}
+
+
+bool TextureArray::Build(int maxLayerSize)
+{
+    if (layers.empty() || texture)
+        return false;
+
+    // Pick the level of every image that fits, the layers take the largest of them
+    width = height = 0;
+    for (Layer& layer : layers)
+    {
+        const vector<MipLevel>& chainLevels = layer.chain.levels;
+        layer.baseLevel = 0;
+        while (layer.baseLevel + 1 < (int)chainLevels.size() &&
+               (chainLevels[layer.baseLevel].width > maxLayerSize || chainLevels[layer.baseLevel].height > maxLayerSize))
+            ++layer.baseLevel;
+
+        const MipLevel& base = chainLevels[layer.baseLevel];
+        width = std::max(width, base.width);
+        height = std::max(height, base.height);
+    }
+
+    levels = 1;
+    while ((std::max(width, height) >> levels) > 0)
+        ++levels;
+
+    glGenTextures(1, &texture);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, (GLsizei)layers.size());
+
+    vector<unsigned char> rgba;
+    residentBytes = 0;
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        Layer& layer = layers[i];
+        const vector<MipLevel>& chainLevels = layer.chain.levels;
+        const MipLevel& base = chainLevels[layer.baseLevel];
+        layer.uvScale[0] = float(base.width) / width;
+        layer.uvScale[1] = float(base.height) / height;
+
+        for (int level = 0; level < levels; ++level)
+        {
+            int levelWidth = std::max(1, width >> level);
+            int levelHeight = std::max(1, height >> level);
+            // Images smaller than the layer run out of levels first and repeat their last one
+            size_t source = std::min(size_t(layer.baseLevel + level), chainLevels.size() - 1);
+            tileLevel(chainLevels[source], layer.chain.channels, levelWidth, levelHeight, rgba);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, (GLint)i, levelWidth, levelHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+            residentBytes += rgba.size();
+        }
+
+        // The pixels live on the GPU now
+        layer.chain = MipChain();
+    }
+
+    // Same sampling as the individual textures had
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return true;
+}
+
+
+void TextureArray::Destroy()
+{
+    if (texture)
+    {
+        URenderState().ForgetTexture(texture);
+        glDeleteTextures(1, &texture);
+    }
+    texture = 0;
+    layers.clear();
+    byPath.clear();
+    byHash.clear();
+    width = height = levels = 0;
+    residentBytes = 0;
+}
+
+
+void TextureArray::Bind(const ShaderProgram& program, int unit) const
+{
+    URenderState().BindTexture(unit, GL_TEXTURE_2D_ARRAY, texture);
+    program.Set(program.Uniform(UNIFORM_TEXTURE_ARRAY), unit);
+}
+
+
+void TextureArray::BindLayer(const ShaderProgram& program, int layer) const
+{
+    const Layer& selected = layers[layer];
+    program.Set(program.Uniform(UNIFORM_LAYER), layer);
+    program.Set(program.Uniform(UNIFORM_UV_SCALE), glm::vec2(selected.uvScale[0], selected.uvScale[1]));
+}
+
+
+void TextureArray::PrintStats() const
+{
+    cout << "INFO: Texture array: " << layers.size() << " layers of "
+         << width << "x" << height << " (" << byPath.size() << " paths), "
+         << residentBytes / 1024 << " KB" << endl;
+    for (const Layer& layer : layers)
+    {
+        if (layer.baseLevel > 0)
+            cout << "INFO:   " << layer.filename << " reduced by " << (1 << layer.baseLevel) << "x to fit" << endl;
+    }
+}
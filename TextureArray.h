@@ -0,0 +1,69 @@
+// TextureArray.h
+// Packs the scene's images into the layers of one GL_TEXTURE_2D_ARRAY, so
+// every static mesh samples the same texture object and a draw only has to
+// select its layer instead of binding a texture.
+
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderProgram.h"
+#include "Texture.h"
+
+// Layers are never larger than this on either axis. Bigger images use the
+// first mip level that fits.
+const int TEXTURE_ARRAY_MAX_LAYER_SIZE = 2048;
+
+class TextureArray
+{
+public:
+    TextureArray() {}
+    ~TextureArray() { Destroy(); }
+
+    // Queues an image and returns its layer (-1 on failure). Images that were
+    // already added, by path or by contents, return the existing layer.
+    int Add(const char* filename);
+
+    // Creates the array from every added image. All layers share the size of the
+    // largest image; smaller images fill a corner of their layer.
+    bool Build(int maxLayerSize = TEXTURE_ARRAY_MAX_LAYER_SIZE);
+    void Destroy();
+
+    GLuint Id() const { return texture; }
+    int LayerCount() const { return (int)layers.size(); }
+
+    // Binds the array on the given texture unit and points uTextureArray at it
+    void Bind(const ShaderProgram& program, int unit) const;
+    // Sets uLayer and uUvScale of the (currently used) program for one draw
+    void BindLayer(const ShaderProgram& program, int layer) const;
+    // Part of the layer the image covers
+    glm::vec2 UvScale(int layer) const { return glm::vec2(layers[layer].uvScale[0], layers[layer].uvScale[1]); }
+
+    void PrintStats() const;
+
+private:
+    struct Layer
+    {
+        std::string filename;
+        MipChain chain;             // released once uploaded
+        int baseLevel = 0;          // first chain level that fits in a layer
+        float uvScale[2] = { 1.0f, 1.0f };
+    };
+
+    std::vector<Layer> layers;
+    std::unordered_map<std::string, int> byPath;
+    std::unordered_map<unsigned long long, int> byHash;
+
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+    size_t residentBytes = 0;
+};
+
+#endif
@@ -0,0 +1,99 @@
+// VertexLayout.h
+// Compile-time vertex formats. A layout is a list of attributes (location,
+// component type, component count); its stride and offsets are constants
+// and Apply records the format in the bound vertex array with the separate
+// attribute format calls (glVertexAttribFormat + glVertexAttribBinding), so
+// the format is independent of the buffer. Vertex arrays with the same
+// layout have the same format, and buffers are attached with Bind.
+//
+//     typedef VertexLayout<VertexAttribute<0, GLfloat, 3>,
+//                          VertexAttribute<1, GLbyte, 4, true>> CompactLayout;
+//     CompactLayout::Apply(VERTEX_BUFFER_BINDING);
+//     CompactLayout::Bind(VERTEX_BUFFER_BINDING, buffer);
+
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <GL/glew.h>        // GLEW library
+
+// Buffer binding points shared by every vertex array: per-vertex data, and
+// the per-instance draw index the static pool and the render queue attach
+const GLuint VERTEX_BUFFER_BINDING = 0;
+const GLuint DRAW_INDEX_BUFFER_BINDING = 1;
+
+// GL type of a component type. Integer components are read as integers by
+// the shader unless the attribute is normalized.
+template <typename T> struct VertexComponentType;
+template <> struct VertexComponentType<GLfloat> { static const GLenum type = GL_FLOAT; static const bool integer = false; };
+template <> struct VertexComponentType<GLbyte> { static const GLenum type = GL_BYTE; static const bool integer = true; };
+template <> struct VertexComponentType<GLubyte> { static const GLenum type = GL_UNSIGNED_BYTE; static const bool integer = true; };
+template <> struct VertexComponentType<GLshort> { static const GLenum type = GL_SHORT; static const bool integer = true; };
+template <> struct VertexComponentType<GLushort> { static const GLenum type = GL_UNSIGNED_SHORT; static const bool integer = true; };
+template <> struct VertexComponentType<GLint> { static const GLenum type = GL_INT; static const bool integer = true; };
+template <> struct VertexComponentType<GLuint> { static const GLenum type = GL_UNSIGNED_INT; static const bool integer = true; };
+
+template <GLuint Location, typename T, GLint Count, bool Normalized = false>
+struct VertexAttribute
+{
+    static_assert(Count >= 1 && Count <= 4, "Vertex attributes have 1 to 4 components");
+    static_assert(!Normalized || VertexComponentType<T>::integer, "Only integer components can be normalized");
+
+    typedef T Component;
+    static const GLuint location = Location;
+    static const GLint count = Count;
+    static const GLenum type = VertexComponentType<T>::type;
+    static const bool normalized = Normalized;
+    // Fed to int/uint shader inputs rather than converted to float
+    static const bool integer = VertexComponentType<T>::integer && !Normalized;
+    static const GLuint size = GLuint(sizeof(T) * Count);
+};
+
+template <typename... Attributes>
+struct VertexLayout;
+
+template <>
+struct VertexLayout<>
+{
+    static const GLuint stride = 0;
+
+    static void ApplyAttributes(GLuint, GLuint) {}
+};
+
+template <typename First, typename... Rest>
+struct VertexLayout<First, Rest...>
+{
+    // Attributes are packed in order with no padding
+    static const GLuint stride = First::size + VertexLayout<Rest...>::stride;
+
+    // Records the format in the bound vertex array, read from binding. A
+    // divisor of 1 advances the attributes per instance instead of per vertex.
+    static void Apply(GLuint binding, GLuint divisor = 0)
+    {
+        ApplyAttributes(binding, 0);
+        glVertexBindingDivisor(binding, divisor);
+    }
+
+    // Attaches buffer (starting at offset bytes) to binding of the bound vertex array
+    static void Bind(GLuint binding, GLuint buffer, GLintptr offset = 0)
+    {
+        glBindVertexBuffer(binding, buffer, offset, stride);
+    }
+
+    static void ApplyAttributes(GLuint binding, GLuint offset)
+    {
+        if (First::integer)
+            glVertexAttribIFormat(First::location, First::count, First::type, offset);
+        else
+            glVertexAttribFormat(First::location, First::count, First::type, First::normalized, offset);
+        glVertexAttribBinding(First::location, binding);
+        glEnableVertexAttribArray(First::location);
+        VertexLayout<Rest...>::ApplyAttributes(binding, offset + First::size);
+    }
+};
+
+// Position, normal and texture coordinate floats: the static pool's vertices and the sphere's
+typedef VertexLayout<VertexAttribute<0, GLfloat, 3>,
+                     VertexAttribute<1, GLfloat, 3>,
+                     VertexAttribute<2, GLfloat, 2>> MeshVertexLayout;
+
+#endif
@@ -0,0 +1,634 @@
+// VirtualTexture.cpp
+// Sparse (virtual) texturing, see VirtualTexture.h
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>         // cout, cerr
+
+#include "stb_image.h"    // Image loading Utility functions
+#include "Mipmap.h"       // CPU mip chain builder
+#include "Texture.h"
+#include "RenderState.h"
+#include "VirtualTexture.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const unsigned PAGE_FILE_MAGIC = 0x58455456;   // "VTEX"
+    const unsigned PAGE_FILE_VERSION = 1;
+
+    const int PADDED_PAGE_SIZE = VT_PAGE_SIZE + 2 * VT_PAGE_BORDER;
+
+    // Streaming limits per frame
+    const size_t MAX_PENDING_PAGES = 64;
+    const int MAX_UPLOADS_PER_FRAME = 8;
+
+    int nextPowerOfTwo(int value)
+    {
+        int result = 1;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    // Plain bilinear resize, only used to bring odd sized images to power of two sizes
+    void resampleBilinear(const unsigned char* src, int width, int height, int channels,
+                          unsigned char* dst, int dstWidth, int dstHeight)
+    {
+        for (int y = 0; y < dstHeight; ++y)
+        {
+            float fy = std::max(0.0f, (y + 0.5f) * height / dstHeight - 0.5f);
+            int y0 = std::min(int(fy), height - 1);
+            int y1 = std::min(y0 + 1, height - 1);
+            float ty = fy - y0;
+            for (int x = 0; x < dstWidth; ++x)
+            {
+                float fx = std::max(0.0f, (x + 0.5f) * width / dstWidth - 0.5f);
+                int x0 = std::min(int(fx), width - 1);
+                int x1 = std::min(x0 + 1, width - 1);
+                float tx = fx - x0;
+                for (int c = 0; c < channels; ++c)
+                {
+                    float top = src[(size_t(y0) * width + x0) * channels + c] * (1 - tx) + src[(size_t(y0) * width + x1) * channels + c] * tx;
+                    float bottom = src[(size_t(y1) * width + x0) * channels + c] * (1 - tx) + src[(size_t(y1) * width + x1) * channels + c] * tx;
+                    dst[(size_t(y) * dstWidth + x) * channels + c] = (unsigned char)(top * (1 - ty) + bottom * ty + 0.5f);
+                }
+            }
+        }
+    }
+
+    // Copies one bordered page out of a level. U wraps (longitude), V clamps (poles).
+    void extractPage(const MipLevel& level, int channels, int pageX, int pageY, unsigned char* out)
+    {
+        for (int j = 0; j < PADDED_PAGE_SIZE; ++j)
+        {
+            int sy = std::min(level.height - 1, std::max(0, pageY * VT_PAGE_SIZE + j - VT_PAGE_BORDER));
+            for (int i = 0; i < PADDED_PAGE_SIZE; ++i)
+            {
+                int sx = ((pageX * VT_PAGE_SIZE + i - VT_PAGE_BORDER) % level.width + level.width) % level.width;
+                const unsigned char* texel = &level.pixels[(size_t(sy) * level.width + sx) * channels];
+                std::copy(texel, texel + channels, out);
+                out += channels;
+            }
+        }
+    }
+
+    template <typename T>
+    void writeValue(ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool readValue(ifstream& in, T& value)
+    {
+        return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+}
+
+
+bool UBuildPageFile(const char* imageFilename, const char* pageFilename)
+{
+    int width, height, channels;
+    unsigned char* image = stbi_load(imageFilename, &width, &height, &channels, 0);
+    if (!image)
+    {
+        cout << "Failed to load image " << imageFilename << endl;
+        return false;
+    }
+    if (channels != 3 && channels != 4)
+    {
+        cout << "Not implemented to handle image with " << channels << " channels" << endl;
+        stbi_image_free(image);
+        return false;
+    }
+    flipImageVertically(image, width, height, channels);
+
+    int virtualWidth = nextPowerOfTwo(std::max(width, VT_PAGE_SIZE));
+    int virtualHeight = nextPowerOfTwo(std::max(height, VT_PAGE_SIZE));
+    if (virtualWidth > VT_PAGE_SIZE * VT_MAX_PAGES_PER_SIDE || virtualHeight > VT_PAGE_SIZE * VT_MAX_PAGES_PER_SIDE)
+    {
+        cout << "Image " << imageFilename << " is larger than " << VT_PAGE_SIZE * VT_MAX_PAGES_PER_SIDE << " texels" << endl;
+        stbi_image_free(image);
+        return false;
+    }
+
+    MipChain chain;
+    bool built;
+    if (virtualWidth != width || virtualHeight != height)
+    {
+        vector<unsigned char> resized(size_t(virtualWidth) * virtualHeight * channels);
+        resampleBilinear(image, width, height, channels, resized.data(), virtualWidth, virtualHeight);
+        stbi_image_free(image);
+        built = UBuildMipChain(resized.data(), virtualWidth, virtualHeight, channels, MIP_FILTER_KAISER, chain, VT_PAGE_SIZE);
+    }
+    else
+    {
+        built = UBuildMipChain(image, width, height, channels, MIP_FILTER_KAISER, chain, VT_PAGE_SIZE);
+        stbi_image_free(image);
+    }
+    if (!built)
+        return false;
+
+    ofstream out(pageFilename, ios::binary);
+    if (!out)
+    {
+        cout << "Could not write page file " << pageFilename << endl;
+        return false;
+    }
+
+    // Header, level sizes, then one offset per page
+    int levelCount = (int)chain.levels.size();
+    writeValue(out, PAGE_FILE_MAGIC);
+    writeValue(out, PAGE_FILE_VERSION);
+    writeValue(out, virtualWidth);
+    writeValue(out, virtualHeight);
+    writeValue(out, channels);
+    writeValue(out, VT_PAGE_SIZE);
+    writeValue(out, VT_PAGE_BORDER);
+    writeValue(out, levelCount);
+
+    size_t pageCount = 0;
+    for (const MipLevel& level : chain.levels)
+    {
+        int pagesX = level.width / VT_PAGE_SIZE;
+        int pagesY = level.height / VT_PAGE_SIZE;
+        writeValue(out, pagesX);
+        writeValue(out, pagesY);
+        pageCount += size_t(pagesX) * pagesY;
+    }
+
+    size_t pageBytes = size_t(PADDED_PAGE_SIZE) * PADDED_PAGE_SIZE * channels;
+    unsigned long long offset = (unsigned long long)out.tellp() + pageCount * sizeof(unsigned long long);
+    for (size_t i = 0; i < pageCount; ++i, offset += pageBytes)
+        writeValue(out, offset);
+
+    vector<unsigned char> page(pageBytes);
+    for (const MipLevel& level : chain.levels)
+    {
+        for (int y = 0; y < level.height / VT_PAGE_SIZE; ++y)
+        {
+            for (int x = 0; x < level.width / VT_PAGE_SIZE; ++x)
+            {
+                extractPage(level, channels, x, y, page.data());
+                out.write(reinterpret_cast<const char*>(page.data()), page.size());
+            }
+        }
+    }
+
+    cout << "INFO: Wrote " << pageCount << " pages (" << levelCount << " levels) to " << pageFilename << endl;
+    return bool(out);
+}
+
+
+bool VirtualTexture::Open(const char* pageFilename, int cachePages, int feedbackW, int feedbackH)
+{
+    Close();
+
+    ifstream in(pageFilename, ios::binary);
+    if (!in)
+        return false;
+
+    unsigned magic, version;
+    int pageSize, border, levelCount;
+    if (!readValue(in, magic) || !readValue(in, version) || magic != PAGE_FILE_MAGIC || version != PAGE_FILE_VERSION)
+        return false;
+    if (!readValue(in, width) || !readValue(in, height) || !readValue(in, channels) ||
+        !readValue(in, pageSize) || !readValue(in, border) || !readValue(in, levelCount))
+    {
+        cout << "Page file " << pageFilename << " is truncated" << endl;
+        return false;
+    }
+    if (pageSize != VT_PAGE_SIZE || border != VT_PAGE_BORDER)
+    {
+        cout << "Page file " << pageFilename << " was built with a different page layout" << endl;
+        return false;
+    }
+
+    // Everything below sizes allocations, so it must be exactly what Build
+    // writes: a virtual size of whole pages, and levels whose axes halve
+    // until they are one page wide
+    int maxSize = VT_PAGE_SIZE * VT_MAX_PAGES_PER_SIDE;
+    int expectedLevels = 1;
+    while ((std::max(width, height) >> expectedLevels) >= VT_PAGE_SIZE)
+        ++expectedLevels;
+    bool valid = width >= VT_PAGE_SIZE && width <= maxSize && width % VT_PAGE_SIZE == 0 &&
+                 height >= VT_PAGE_SIZE && height <= maxSize && height % VT_PAGE_SIZE == 0 &&
+                 (channels == 3 || channels == 4) && levelCount == expectedLevels;
+
+    size_t pageCount = 0;
+    if (valid)
+        levels.resize(levelCount);
+    for (int i = 0; valid && i < levelCount; ++i)
+    {
+        Level& level = levels[i];
+        valid = readValue(in, level.pagesX) && readValue(in, level.pagesY) &&
+                level.pagesX == std::max(1, (width >> i) / VT_PAGE_SIZE) &&
+                level.pagesY == std::max(1, (height >> i) / VT_PAGE_SIZE);
+        level.firstPage = pageCount;
+        pageCount += size_t(level.pagesX) * level.pagesY;
+    }
+    if (valid)
+    {
+        pageOffsets.resize(pageCount);
+        valid = bool(in.read(reinterpret_cast<char*>(pageOffsets.data()), pageCount * sizeof(unsigned long long)));
+    }
+    if (!valid)
+    {
+        cout << "Page file " << pageFilename << " is truncated or corrupt" << endl;
+        levels.clear();
+        pageOffsets.clear();
+        return false;
+    }
+    filename = pageFilename;
+
+    // Physical page cache
+    cachePagesPerSide = cachePages;
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    cachePagesPerSide = std::min(cachePagesPerSide, std::min(int(maxTextureSize / PADDED_PAGE_SIZE), VT_MAX_PAGES_PER_SIDE));
+    int cacheSize = cachePagesPerSide * PADDED_PAGE_SIZE;
+
+    glGenTextures(1, &cacheTexture);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, cacheTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, cacheSize, cacheSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Page table, one texel per virtual page and one level per mip level
+    glGenTextures(1, &pageTable);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, pageTable);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_RGBA8, levels[0].pagesX, levels[0].pagesY);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    pageTableLevels.resize(levelCount);
+    for (int i = 0; i < levelCount; ++i)
+        pageTableLevels[i].assign(size_t(levels[i].pagesX) * levels[i].pagesY * 4, 0);
+    slots.assign(size_t(cachePagesPerSide) * cachePagesPerSide, Slot());
+
+    // Feedback target: page ids in RGBA8 plus depth, read back through two PBOs
+    feedbackWidth = feedbackW;
+    feedbackHeight = feedbackH;
+    glGenTextures(1, &feedbackColor);
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, feedbackColor);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, feedbackWidth, feedbackHeight);
+    glGenRenderbuffers(1, &feedbackDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &feedbackFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        cout << "Virtual texture feedback framebuffer is incomplete" << endl;
+        Close();
+        return false;
+    }
+
+    glGenBuffers(2, feedbackBuffers);
+    for (GLuint buffer : feedbackBuffers)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size_t(feedbackWidth) * feedbackHeight * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // The coarsest level is always resident so every lookup has a fallback
+    int coarsest = levelCount - 1;
+    for (int y = 0; y < levels[coarsest].pagesY; ++y)
+    {
+        for (int x = 0; x < levels[coarsest].pagesX; ++x)
+        {
+            LoadedPage page;
+            page.pageId = PageId(coarsest, x, y);
+            int slot = AllocateSlot();
+            if (slot < 0 || !ReadPage(in, page.pageId, page.pixels))
+            {
+                Close();
+                return false;
+            }
+            UploadPage(slot, page);
+            slots[slot].pinned = true;
+        }
+    }
+    RebuildPageTable();
+
+    loaderQuit = false;
+    loader = std::thread(&VirtualTexture::LoaderMain, this);
+
+    return true;
+}
+
+
+void VirtualTexture::Close()
+{
+    if (loader.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            loaderQuit = true;
+        }
+        loaderSignal.notify_all();
+        loader.join();
+    }
+    loadQueue.clear();
+    loadedPages.clear();
+
+    if (pageTable)
+    {
+        URenderState().ForgetTexture(pageTable);
+        glDeleteTextures(1, &pageTable);
+    }
+    if (cacheTexture)
+    {
+        URenderState().ForgetTexture(cacheTexture);
+        glDeleteTextures(1, &cacheTexture);
+    }
+    if (feedbackFramebuffer)
+        glDeleteFramebuffers(1, &feedbackFramebuffer);
+    if (feedbackColor)
+    {
+        URenderState().ForgetTexture(feedbackColor);
+        glDeleteTextures(1, &feedbackColor);
+    }
+    if (feedbackDepth)
+        glDeleteRenderbuffers(1, &feedbackDepth);
+    if (feedbackBuffers[0])
+        glDeleteBuffers(2, feedbackBuffers);
+    pageTable = cacheTexture = feedbackFramebuffer = feedbackColor = feedbackDepth = 0;
+    feedbackBuffers[0] = feedbackBuffers[1] = 0;
+    feedbackWritten[0] = feedbackWritten[1] = false;
+
+    levels.clear();
+    pageOffsets.clear();
+    slots.clear();
+    residentPages.clear();
+    pendingPages.clear();
+    pageTableLevels.clear();
+}
+
+
+void VirtualTexture::BeginFeedback()
+{
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+
+    // Derivatives are larger in the smaller target, so bias the lod back down
+    feedbackLodBias = -std::log2(std::max(1, (int)savedViewport[2]) / float(feedbackWidth));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+
+void VirtualTexture::EndFeedback()
+{
+    // Asynchronous read back, mapped two frames later in Update
+    int buffer = frame & 1;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[buffer]);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedbackWritten[buffer] = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+
+void VirtualTexture::Update()
+{
+    ++frame;
+
+    // 1. Collect the pages seen by the feedback pass two frames ago
+    int buffer = frame & 1;
+    vector<int> missing;
+    if (feedbackWritten[buffer])
+    {
+        unordered_set<int> seen;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[buffer]);
+        const unsigned char* texels = static_cast<const unsigned char*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_t(feedbackWidth) * feedbackHeight * 4, GL_MAP_READ_BIT));
+        if (texels)
+        {
+            for (size_t i = 0; i < size_t(feedbackWidth) * feedbackHeight; ++i)
+            {
+                const unsigned char* texel = texels + i * 4;
+                int level = texel[2];
+                if (texel[3] == 0 || level >= (int)levels.size() || texel[0] >= levels[level].pagesX || texel[1] >= levels[level].pagesY)
+                    continue;
+
+                // Request the page and every coarser page covering it
+                int x = texel[0];
+                int y = texel[1];
+                while (seen.insert(PageId(level, x, y)).second && level + 1 < (int)levels.size())
+                {
+                    x = x * levels[level + 1].pagesX / levels[level].pagesX;
+                    y = y * levels[level + 1].pagesY / levels[level].pagesY;
+                    ++level;
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackWritten[buffer] = false;
+
+        for (int pageId : seen)
+        {
+            auto resident = residentPages.find(pageId);
+            if (resident != residentPages.end())
+                slots[resident->second].lastUsed = frame;
+            else if (pendingPages.find(pageId) == pendingPages.end())
+                missing.push_back(pageId);
+        }
+    }
+
+    // 2. Queue missing pages, coarse levels first so fallbacks arrive early
+    std::sort(missing.begin(), missing.end(), [](int a, int b) { return PageLevel(a) > PageLevel(b); });
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        for (int pageId : missing)
+        {
+            if (pendingPages.size() >= MAX_PENDING_PAGES)
+                break;
+            pendingPages.insert(pageId);
+            loadQueue.push_back(pageId);
+        }
+    }
+    loaderSignal.notify_one();
+
+    // 3. Upload pages the loader has finished
+    vector<LoadedPage> ready;
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        while (!loadedPages.empty() && (int)ready.size() < MAX_UPLOADS_PER_FRAME)
+        {
+            ready.push_back(std::move(loadedPages.front()));
+            loadedPages.pop_front();
+        }
+    }
+    for (const LoadedPage& page : ready)
+    {
+        pendingPages.erase(page.pageId);
+        if (page.pixels.empty())
+            continue;
+        int slot = AllocateSlot();
+        if (slot < 0)
+            continue;       // every slot is in use this frame, the page will be requested again
+        UploadPage(slot, page);
+    }
+
+    if (pageTableDirty)
+        RebuildPageTable();
+}
+
+
+void VirtualTexture::Bind(const ShaderProgram& program, int pageTableUnit, int cacheUnit, float lodBias) const
+{
+    URenderState().BindTexture(pageTableUnit, GL_TEXTURE_2D, pageTable);
+    URenderState().BindTexture(cacheUnit, GL_TEXTURE_2D, cacheTexture);
+
+    program.Set(program.Uniform(UNIFORM_PAGE_TABLE), pageTableUnit);
+    program.Set(program.Uniform(UNIFORM_PHYSICAL_CACHE), cacheUnit);
+    program.Set(program.Uniform(UNIFORM_VT_VIRTUAL), glm::vec4((float)levels[0].pagesX, (float)levels[0].pagesY, (float)levels.size() - 1, (float)VT_PAGE_SIZE));
+    program.Set(program.Uniform(UNIFORM_VT_CACHE), glm::vec4((float)PADDED_PAGE_SIZE, (float)VT_PAGE_BORDER, (float)cachePagesPerSide * PADDED_PAGE_SIZE, 0.0f));
+    program.Set(program.Uniform(UNIFORM_VT_LOD_BIAS), lodBias);
+}
+
+
+void VirtualTexture::PrintStats() const
+{
+    cout << "INFO: Virtual texture " << filename << ": " << width << "x" << height
+         << ", " << residentPages.size() << "/" << slots.size() << " pages resident, "
+         << pendingPages.size() << " pending, " << pagesUploaded << " uploaded, "
+         << pagesEvicted << " evicted" << endl;
+}
+
+
+bool VirtualTexture::ReadPage(ifstream& in, int pageId, vector<unsigned char>& pixels) const
+{
+    const Level& level = levels[PageLevel(pageId)];
+    size_t index = level.firstPage + size_t(PageY(pageId)) * level.pagesX + PageX(pageId);
+
+    pixels.resize(size_t(PADDED_PAGE_SIZE) * PADDED_PAGE_SIZE * channels);
+    in.clear();
+    in.seekg((streamoff)pageOffsets[index]);
+    return bool(in.read(reinterpret_cast<char*>(pixels.data()), pixels.size()));
+}
+
+
+// Returns a free slot, or evicts the least recently used page not needed this frame
+int VirtualTexture::AllocateSlot()
+{
+    int best = -1;
+    for (int i = 0; i < (int)slots.size(); ++i)
+    {
+        const Slot& slot = slots[i];
+        if (slot.pageId < 0)
+            return i;
+        if (slot.pinned || slot.lastUsed >= frame)
+            continue;
+        if (best < 0 || slot.lastUsed < slots[best].lastUsed)
+            best = i;
+    }
+
+    if (best >= 0)
+    {
+        residentPages.erase(slots[best].pageId);
+        slots[best] = Slot();
+        pageTableDirty = true;
+        ++pagesEvicted;
+    }
+    return best;
+}
+
+
+void VirtualTexture::UploadPage(int slot, const LoadedPage& page)
+{
+    int x = slot % cachePagesPerSide;
+    int y = slot / cachePagesPerSide;
+
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, cacheTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x * PADDED_PAGE_SIZE, y * PADDED_PAGE_SIZE, PADDED_PAGE_SIZE, PADDED_PAGE_SIZE,
+                    channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, page.pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    slots[slot].pageId = page.pageId;
+    slots[slot].lastUsed = frame;
+    residentPages[page.pageId] = slot;
+    pageTableDirty = true;
+    ++pagesUploaded;
+}
+
+
+// Every page table texel points at the finest resident page covering it
+void VirtualTexture::RebuildPageTable()
+{
+    URenderState().BindTexture(RENDER_STATE_UPLOAD_UNIT, GL_TEXTURE_2D, pageTable);
+    for (int l = (int)levels.size() - 1; l >= 0; --l)
+    {
+        const Level& level = levels[l];
+        vector<unsigned char>& table = pageTableLevels[l];
+        for (int y = 0; y < level.pagesY; ++y)
+        {
+            for (int x = 0; x < level.pagesX; ++x)
+            {
+                unsigned char* entry = &table[(size_t(y) * level.pagesX + x) * 4];
+                auto resident = residentPages.find(PageId(l, x, y));
+                if (resident != residentPages.end())
+                {
+                    entry[0] = (unsigned char)(resident->second % cachePagesPerSide);
+                    entry[1] = (unsigned char)(resident->second / cachePagesPerSide);
+                    entry[2] = (unsigned char)l;
+                    entry[3] = 255;
+                }
+                else if (l + 1 < (int)levels.size())
+                {
+                    const Level& parent = levels[l + 1];
+                    int px = x * parent.pagesX / level.pagesX;
+                    int py = y * parent.pagesY / level.pagesY;
+                    const unsigned char* parentEntry = &pageTableLevels[l + 1][(size_t(py) * parent.pagesX + px) * 4];
+                    std::copy(parentEntry, parentEntry + 4, entry);
+                }
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, level.pagesX, level.pagesY, GL_RGBA, GL_UNSIGNED_BYTE, table.data());
+    }
+    pageTableDirty = false;
+}
+
+
+// Reads requested pages from disk so the render thread never blocks on I/O
+void VirtualTexture::LoaderMain()
+{
+    ifstream in(filename, ios::binary);
+    for (;;)
+    {
+        LoadedPage page;
+        {
+            std::unique_lock<std::mutex> lock(loaderMutex);
+            loaderSignal.wait(lock, [this] { return loaderQuit || !loadQueue.empty(); });
+            if (loaderQuit)
+                return;
+            page.pageId = loadQueue.front();
+            loadQueue.pop_front();
+        }
+
+        if (!ReadPage(in, page.pageId, page.pixels))
+            page.pixels.clear();     // still reported so the page is no longer pending
+
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        loadedPages.push_back(std::move(page));
+    }
+}
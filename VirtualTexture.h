@@ -0,0 +1,143 @@
+// VirtualTexture.h
+// Sparse (virtual) texturing for images larger than GL_MAX_TEXTURE_SIZE.
+//
+// UBuildPageFile tiles an image and its mip levels into bordered pages on
+// disk. At runtime a low resolution feedback pass records which pages are
+// visible, those pages are read on a loader thread and uploaded into a
+// fixed size physical page cache, and a page table texture maps every
+// virtual page to the finest resident page covering it.
+
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <GL/glew.h>        // GLEW library
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ShaderProgram.h"
+
+// Texels per page side, not counting the border
+const int VT_PAGE_SIZE = 128;
+// Border texels on every side of a page for bilinear filtering
+const int VT_PAGE_BORDER = 4;
+// Pages are addressed with 8 bits per axis, so 256 pages (32K texels) per side at most
+const int VT_MAX_PAGES_PER_SIDE = 256;
+
+// Tiles an image file into a page file. Images are resampled to power of two
+// sizes first, since every level must be a whole number of pages.
+bool UBuildPageFile(const char* imageFilename, const char* pageFilename);
+
+
+class VirtualTexture
+{
+public:
+    VirtualTexture() {}
+    ~VirtualTexture() { Close(); }
+
+    // Opens a page file, creates a physical cache of cachePagesPerSide^2 pages and a
+    // feedback target of the given size. The coarsest level is loaded immediately.
+    bool Open(const char* pageFilename, int cachePagesPerSide, int feedbackWidth, int feedbackHeight);
+    void Close();
+    bool IsOpen() const { return pageTable != 0; }
+
+    // Feedback pass: draw everything using the virtual texture with the feedback
+    // program between these calls. The result is read back asynchronously.
+    void BeginFeedback();
+    void EndFeedback();
+
+    // Consumes the previous feedback, queues missing pages and uploads loaded ones
+    void Update();
+
+    // Binds the page table and cache on the given texture units and sets the
+    // sampling uniforms of the (currently used) program. lodBias is 0 for the
+    // main pass and FeedbackLodBias() for the feedback pass.
+    void Bind(const ShaderProgram& program, int pageTableUnit, int cacheUnit, float lodBias = 0.0f) const;
+    float FeedbackLodBias() const { return feedbackLodBias; }
+
+    void PrintStats() const;
+
+private:
+    struct Level
+    {
+        int pagesX;
+        int pagesY;
+        size_t firstPage;                   // index of the level's first page in pageOffsets
+    };
+
+    struct Slot
+    {
+        int pageId = -1;                    // resident page, -1 when free
+        unsigned lastUsed = 0;              // frame the page was last requested
+        bool pinned = false;                // never evicted (coarsest level)
+    };
+
+    struct LoadedPage
+    {
+        int pageId;
+        std::vector<unsigned char> pixels;
+    };
+
+    static int PageId(int level, int x, int y) { return (level << 16) | (y << 8) | x; }
+    static int PageLevel(int pageId) { return pageId >> 16; }
+    static int PageY(int pageId) { return (pageId >> 8) & 0xFF; }
+    static int PageX(int pageId) { return pageId & 0xFF; }
+
+    bool ReadPage(std::ifstream& in, int pageId, std::vector<unsigned char>& pixels) const;
+    int AllocateSlot();
+    void UploadPage(int slot, const LoadedPage& page);
+    void RebuildPageTable();
+    void LoaderMain();
+
+    // page file layout
+    std::string filename;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned long long> pageOffsets;
+
+    // GPU resources
+    GLuint pageTable = 0;
+    GLuint cacheTexture = 0;
+    GLuint feedbackFramebuffer = 0;
+    GLuint feedbackColor = 0;
+    GLuint feedbackDepth = 0;
+    GLuint feedbackBuffers[2] = { 0, 0 };
+    int feedbackWidth = 0;
+    int feedbackHeight = 0;
+    float feedbackLodBias = 0.0f;
+    GLint savedViewport[4];
+    GLint savedFramebuffer = 0;
+
+    // residency
+    int cachePagesPerSide = 0;
+    std::vector<Slot> slots;
+    std::unordered_map<int, int> residentPages;     // page id -> slot
+    std::unordered_set<int> pendingPages;           // queued or loading
+    std::vector<std::vector<unsigned char>> pageTableLevels;
+    bool pageTableDirty = false;
+    unsigned frame = 0;
+    bool feedbackWritten[2] = { false, false };
+
+    // loader thread
+    std::thread loader;
+    std::mutex loaderMutex;
+    std::condition_variable loaderSignal;
+    std::deque<int> loadQueue;
+    std::deque<LoadedPage> loadedPages;
+    bool loaderQuit = false;
+
+    // stats
+    unsigned long long pagesUploaded = 0;
+    unsigned long long pagesEvicted = 0;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#version 440 core
+// Planet fragment shader: samples the virtual texture through its page table
+
+in vec2 vertexTextureCoordinate;
+
+out vec4 fragmentColor;
+
+uniform sampler2D uPageTable;     // finest resident page for every virtual page and level
+uniform sampler2D uPhysicalCache; // resident pages with borders
+uniform vec4 uVtVirtual;          // pages across and down at level 0, coarsest level, page size in texels
+uniform vec4 uVtCache;            // padded page size, border, cache size in texels
+uniform float uVtLodBias;
+
+// Mip level of the virtual texture from the screen space derivatives
+float virtualLod(vec2 uv)
+{
+    vec2 texel = uv * uVtVirtual.xy * uVtVirtual.w;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    return clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + uVtLodBias, 0.0, uVtVirtual.z);
+}
+
+void main()
+{
+    vec2 uv = vec2(fract(vertexTextureCoordinate.x), clamp(vertexTextureCoordinate.y, 0.0, 1.0));
+    int level = int(virtualLod(uv));
+    ivec2 pages = max(ivec2(uVtVirtual.xy) >> level, ivec2(1));
+    ivec2 page = min(ivec2(uv * vec2(pages)), pages - 1);
+
+    // The entry may point at a coarser page while the requested one streams in
+    vec4 entry = floor(texelFetch(uPageTable, page, level) * 255.0 + 0.5);
+    ivec2 mappedPages = max(ivec2(uVtVirtual.xy) >> int(entry.z), ivec2(1));
+    vec2 inPage = uv * vec2(mappedPages) - vec2(min(ivec2(uv * vec2(mappedPages)), mappedPages - 1));
+
+    vec2 texel = entry.xy * uVtCache.x + uVtCache.y + inPage * uVtVirtual.w;
+    fragmentColor = textureLod(uPhysicalCache, texel / uVtCache.z, 0.0);
+}
@@ -0,0 +1,26 @@
+#version 440 core
+// Planet feedback fragment shader: writes the page each pixel needs
+
+in vec2 vertexTextureCoordinate;
+
+out vec4 feedback;
+
+uniform vec4 uVtVirtual;
+uniform float uVtLodBias;
+
+float virtualLod(vec2 uv)
+{
+    vec2 texel = uv * uVtVirtual.xy * uVtVirtual.w;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    return clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + uVtLodBias, 0.0, uVtVirtual.z);
+}
+
+void main()
+{
+    vec2 uv = vec2(fract(vertexTextureCoordinate.x), clamp(vertexTextureCoordinate.y, 0.0, 1.0));
+    int level = int(virtualLod(uv));
+    ivec2 pages = max(ivec2(uVtVirtual.xy) >> level, ivec2(1));
+    ivec2 page = min(ivec2(uv * vec2(pages)), pages - 1);
+    feedback = vec4(vec2(page), float(level), 255.0) / 255.0; // page x, page y, level, valid
+}
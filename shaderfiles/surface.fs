@@ -0,0 +1,93 @@
+#version 440 core
+// Surface fragment shader, see surface.vs for the feature defines
+
+#ifdef INSTANCED
+flat in vec3 vertexMaterial; // uv scale, texture layer (-1 untextured)
+#endif
+
+#ifdef TEXTURED
+in vec2 vertexTextureCoordinate;
+
+uniform sampler2DArray uTextureArray;
+#ifndef INSTANCED
+uniform int uLayer;     // layer of the mesh's image
+uniform vec2 uUvScale;  // part of the layer the image covers
+#endif
+#endif
+
+#ifdef LIT
+in vec3 vertexPosition;
+#ifndef DERIVED_NORMALS
+in vec3 vertexNormal;
+#endif
+
+uniform vec3 uLightPosition;
+uniform vec3 uLightColor;
+
+//Per-frame camera data shared by all programs (see CameraBuffer.h)
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 cameraPosition;
+    float time;
+};
+#endif
+
+out vec4 fragmentColor;
+
+void main()
+{
+#ifdef TEXTURED
+    // Gradients of the unwrapped coordinates, taken before any branch. The
+    // wrapped ones jump by a whole image at the seams, where they would
+    // select the smallest mip.
+    vec2 uvDx = dFdx(vertexTextureCoordinate);
+    vec2 uvDy = dFdy(vertexTextureCoordinate);
+#endif
+
+#ifdef INSTANCED
+    // Untextured pool draws (the lamp) are plain white and unlit
+    if (vertexMaterial.z < 0.0)
+    {
+        fragmentColor = vec4(1.0f);
+        return;
+    }
+#endif
+
+    vec4 color = vec4(1.0f);
+#ifdef TEXTURED
+    // Repeat within the image's rect, the layer may be larger than the image
+#ifdef INSTANCED
+    vec2 uvScale = vertexMaterial.xy;
+    float layer = vertexMaterial.z;
+#else
+    vec2 uvScale = uUvScale;
+    float layer = float(uLayer);
+#endif
+    color = textureGrad(uTextureArray, vec3(fract(vertexTextureCoordinate) * uvScale, layer), uvDx * uvScale, uvDy * uvScale);
+#endif
+
+#ifdef LIT
+    vec3 toLight = normalize(uLightPosition - vertexPosition);
+    vec3 toCamera = normalize(cameraPosition - vertexPosition);
+#ifdef DERIVED_NORMALS
+    // Face normal from how the position changes across the pixel
+    vec3 surfaceNormal = normalize(cross(dFdx(vertexPosition), dFdy(vertexPosition)));
+#else
+    // Faces are not culled and the older meshes mix windings, so generated
+    // normals may point away; light whichever side the camera sees
+    vec3 surfaceNormal = normalize(vertexNormal);
+    if (dot(surfaceNormal, toCamera) < 0.0)
+        surfaceNormal = -surfaceNormal;
+#endif
+
+    float ambient = 0.3f;
+    float diffuse = max(dot(surfaceNormal, toLight), 0.0f);
+    float specular = 0.5f * pow(max(dot(toCamera, reflect(-toLight, surfaceNormal)), 0.0f), 32.0f);
+    color.rgb = color.rgb * (ambient + diffuse * uLightColor) + specular * uLightColor;
+#endif
+
+    fragmentColor = color;
+}
@@ -0,0 +1,77 @@
+#version 440 core
+// Surface vertex shader. ShaderVariants inserts the variant's feature
+// defines after the #version line (see ShaderVariants.h):
+//   TEXTURED         texture coordinates for the texture array
+//   LIT              world position (and normal) for the point light
+//   INSTANCED        transform and material from the static pool's draw data
+//   DERIVED_NORMALS  no normal attribute, the fragment shader derives one
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in uint drawIndex; // per instance, set by the draw's baseInstance
+
+#ifdef INSTANCED
+//Transform and material of every static pool draw (see StaticGeometry.h)
+struct DrawData
+{
+    mat4 model;
+    vec4 material; // uv scale, texture layer (-1 untextured), unused
+};
+
+layout(std430, binding = 1) readonly buffer Draws
+{
+    DrawData draws[];
+};
+
+flat out vec3 vertexMaterial;
+#else
+//Model matrices of the render queue's draws, written once per batch (see RenderQueue.h)
+layout(std430, binding = 2) readonly buffer QueueDraws
+{
+    mat4 models[];
+};
+#endif
+
+//Per-frame camera data shared by all programs (see CameraBuffer.h)
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec3 cameraPosition;
+    float time;
+};
+
+#ifdef TEXTURED
+out vec2 vertexTextureCoordinate;
+#endif
+#ifdef LIT
+out vec3 vertexPosition; // world space
+#ifndef DERIVED_NORMALS
+out vec3 vertexNormal;
+#endif
+#endif
+
+void main()
+{
+#ifdef INSTANCED
+    mat4 model = draws[drawIndex].model;
+    vertexMaterial = draws[drawIndex].material.xyz;
+#else
+    mat4 model = models[drawIndex];
+#endif
+
+    vec4 worldPosition = model * vec4(position, 1.0f);
+    gl_Position = viewProjection * worldPosition; // transforms vertices to clip coordinates
+
+#ifdef TEXTURED
+    vertexTextureCoordinate = textureCoordinate;
+#endif
+#ifdef LIT
+    vertexPosition = worldPosition.xyz;
+#ifndef DERIVED_NORMALS
+    vertexNormal = mat3(transpose(inverse(model))) * normal;
+#endif
+#endif
+}